@@ -130,9 +130,15 @@ DROP TABLE IF EXISTS `offlinemessage`;
 /*!40101 SET @saved_cs_client     = @@character_set_client */;
 /*!40101 SET character_set_client = utf8 */;
 CREATE TABLE `offlinemessage` (
+  -- MODIFICATION: Added an auto-increment id, used as the paging cursor for offline delivery
+  `id` bigint(20) NOT NULL AUTO_INCREMENT,
   -- MODIFICATION: Changed userid to BIGINT
   `userid` bigint(20) NOT NULL,
-  `message` varchar(500) NOT NULL
+  -- MODIFICATION: The serialized message is stored as opaque bytes and spliced into the
+  -- offline page unparsed; MEDIUMBLOB lifts the old 500-character limit
+  `message` mediumblob NOT NULL,
+  PRIMARY KEY (`id`),
+  KEY `userid_id` (`userid`,`id`)
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4; -- MODIFICATION: Changed charset to utf8mb4
 /*!40101 SET character_set_client = @saved_cs_client */;
 
@@ -142,7 +148,7 @@ CREATE TABLE `offlinemessage` (
 
 LOCK TABLES `offlinemessage` WRITE;
 /*!40000 ALTER TABLE `offlinemessage` DISABLE KEYS */;
-INSERT INTO `offlinemessage` VALUES (19,'{\"groupid\":1,\"id\":21,\"msg\":\"hello\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-22 00:43:59\"}'),(19,'{\"groupid\":1,\"id\":21,\"msg\":\"helo!!!\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-22 22:43:21\"}'),(19,'{\"groupid\":1,\"id\":13,\"msg\":\"hahahahaha\",\"msgid\":10,\"name\":\"zhang san\",\"time\":\"2020-02-22 22:59:56\"}'),(19,'{\"groupid\":1,\"id\":13,\"msg\":\"hahahahaha\",\"msgid\":10,\"name\":\"zhang san\",\"time\":\"2020-02-23 17:59:26\"}'),(19,'{\"groupid\":1,\"id\":21,\"msg\":\"wowowowowow\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-23 17:59:34\"}');
+INSERT INTO `offlinemessage` (`userid`, `message`) VALUES (19,'{\"groupid\":1,\"id\":21,\"msg\":\"hello\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-22 00:43:59\"}'),(19,'{\"groupid\":1,\"id\":21,\"msg\":\"helo!!!\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-22 22:43:21\"}'),(19,'{\"groupid\":1,\"id\":13,\"msg\":\"hahahahaha\",\"msgid\":10,\"name\":\"zhang san\",\"time\":\"2020-02-22 22:59:56\"}'),(19,'{\"groupid\":1,\"id\":13,\"msg\":\"hahahahaha\",\"msgid\":10,\"name\":\"zhang san\",\"time\":\"2020-02-23 17:59:26\"}'),(19,'{\"groupid\":1,\"id\":21,\"msg\":\"wowowowowow\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-23 17:59:34\"}');
 /*!40000 ALTER TABLE `offlinemessage` ENABLE KEYS */;
 UNLOCK TABLES;
 
@@ -0,0 +1,101 @@
+#ifndef MPMCQUEUE_H
+#define MPMCQUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// 有界无锁多生产者多消费者环形队列 (Dmitry Vyukov 的 bounded MPMC queue)
+// 每个槽位带一个序号，生产者/消费者只通过 CAS 争抢各自的位置计数器，
+// 入队和出队都不需要加锁。容量是精确的：队列中最多同时存在 capacity 个元素。
+template<class T>
+class MPMCQueue {
+public:
+    explicit MPMCQueue(size_t capacity)
+        : capacity_(capacity == 0 ? 1 : capacity), cells_(capacity_),
+          enqueuePos_(0), dequeuePos_(0) {
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    // 入队，队列已满时返回 false
+    template<class U>
+    bool tryPush(U&& value) {
+        Cell* cell;
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos % capacity_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // 槽位空闲，尝试占有它
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 槽位上一轮的数据还没被取走，队列已满
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::forward<U>(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 出队，队列为空时返回 false
+    bool tryPop(T& value) {
+        Cell* cell;
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos % capacity_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 槽位还没有被写入，队列为空
+                return false;
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        // 释放槽位上的对象，避免任务闭包持有的资源（如连接）被延迟释放
+        cell->data = T();
+        cell->sequence.store(pos + capacity_, std::memory_order_release);
+        return true;
+    }
+
+    // 近似判断队列是否为空，只用于工作线程休眠前的检查
+    bool empty() const {
+        return enqueuePos_.load(std::memory_order_seq_cst) ==
+               dequeuePos_.load(std::memory_order_seq_cst);
+    }
+
+    size_t capacity() const { return capacity_; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    const size_t capacity_;
+    std::vector<Cell> cells_;
+
+    // 生产者和消费者的位置计数器放在不同的缓存行，避免伪共享
+    alignas(64) std::atomic<size_t> enqueuePos_;
+    alignas(64) std::atomic<size_t> dequeuePos_;
+};
+
+#endif // MPMCQUEUE_H
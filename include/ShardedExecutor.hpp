@@ -0,0 +1,78 @@
+#ifndef SHARDEDEXECUTOR_H
+#define SHARDEDEXECUTOR_H
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <atomic>
+#include "ThreadPool.hpp"
+
+// 分片执行器：每个分片是一个单工作线程的 ThreadPool，拥有独立的任务队列和锁
+// 任务按 key（通常是用户ID）哈希到固定分片，因此：
+//   1. 同一个 key 的任务严格按提交顺序串行执行（同一用户的消息不会乱序）
+//   2. 不同分片之间没有共享锁，提交任务时不再争用同一把全局锁
+class ShardedExecutor {
+public:
+    // shardCount: 分片（工作线程）数量
+    // queueCapacity: 所有分片任务队列的总容量，平均分配到每个分片
+    ShardedExecutor(size_t shardCount, size_t queueCapacity);
+
+    // 析构时各分片依次执行完剩余任务后退出
+    ~ShardedExecutor() = default;
+
+    // 停止接受新任务，各分片依次执行完剩余任务后退出；之后 enqueue 一律返回 false
+    void stop();
+    bool stopped() const { return stopped_.load(std::memory_order_acquire); }
+
+    ShardedExecutor(const ShardedExecutor&) = delete;
+    ShardedExecutor& operator=(const ShardedExecutor&) = delete;
+
+    // 将任务提交到 key 对应的分片
+    // 如果成功将任务放入队列，返回 true；如果该分片队列已满或已停止，返回 false。
+    template<class F>
+    bool enqueue(size_t key, F&& task);
+
+    size_t shardCount() const { return shards_.size(); }
+
+    // key 对应的分片下标：下标相同的 key 提交的任务在同一线程中串行执行
+    size_t shardOf(size_t key) const;
+
+private:
+    std::vector<std::unique_ptr<ThreadPool>> shards_;
+    std::atomic<bool> stopped_;
+};
+
+inline ShardedExecutor::ShardedExecutor(size_t shardCount, size_t queueCapacity) : stopped_(false) {
+    if (shardCount == 0) {
+        shardCount = 1;
+    }
+    // 向上取整，保证总容量不小于 queueCapacity
+    size_t shardCapacity = (queueCapacity + shardCount - 1) / shardCount;
+    shards_.reserve(shardCount);
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards_.emplace_back(new ThreadPool(1, shardCapacity));
+    }
+}
+
+inline void ShardedExecutor::stop() {
+    stopped_.store(true, std::memory_order_release);
+    for (auto &shard : shards_) {
+        shard->stop();
+    }
+}
+
+inline size_t ShardedExecutor::shardOf(size_t key) const {
+    // 先打散 key，避免连接指针等对齐的值集中到少数分片
+    uint64_t h = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 32;
+    return h % shards_.size();
+}
+
+template<class F>
+bool ShardedExecutor::enqueue(size_t key, F&& task) {
+    // 单工作线程的分片天然保证同一 key 的任务先进先出
+    return shards_[shardOf(key)]->enqueue(std::forward<F>(task));
+}
+
+#endif // SHARDEDEXECUTOR_H
@@ -2,12 +2,12 @@
 #define THREADPOOL_H
 
 #include <vector>
-#include <queue>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
 #include <atomic>
+#include "MPMCQueue.hpp"
 
 class ThreadPool {
 public:
@@ -17,6 +17,9 @@ public:
     // 析构函数：优雅地停止线程池
     ~ThreadPool();
 
+    // 停止接受新任务，执行完已接受的任务后等待所有工作线程退出；可重复调用，析构函数也会调用
+    void stop();
+
     // 提交任务到任务队列
     // F: 可调用对象类型 (如 lambda)
     // 如果成功将任务放入队列，返回 true；如果队列已满或线程池已停止，返回 false。
@@ -24,80 +27,102 @@ public:
     bool enqueue(F&& task);
 
 private:
+    // 工作线程休眠前自旋尝试取任务的次数
+    static const int kSpinCount = 128;
+
+    // 工作线程主循环
+    void workerLoop();
+
     // 存储工作线程的容器
     std::vector<std::thread> workers_;
-    // 任务队列
-    std::queue<std::function<void()>> tasks_;
-
-    // 任务队列的最大容量
-    const size_t queueCapacity_;
+    // 无锁有界任务队列，容量即为拒绝新任务的上限
+    MPMCQueue<std::function<void()>> tasks_;
 
-    // 同步机制
-    std::mutex queueMutex_;
+    // 休眠机制：只有队列持续为空时工作线程才会在条件变量上休眠，
+    // 生产者只在有线程休眠时才加锁唤醒，常规路径上完全无锁
+    std::mutex sleepMutex_;
     std::condition_variable condition_;
+    std::atomic<int> sleepers_;
     std::atomic<bool> stop_;
 };
 
 // 构造函数实现
 inline ThreadPool::ThreadPool(size_t threadCount, size_t queueCapacity)
-    : queueCapacity_(queueCapacity), stop_(false) {
+    : tasks_(queueCapacity), sleepers_(0), stop_(false) {
     // 启动指定数量的工作线程
     for (size_t i = 0; i < threadCount; ++i) {
-        workers_.emplace_back([this] {
-            // 每个工作线程的执行逻辑
-            for (;;) {
-                std::function<void()> task;
-                {
-                    // 使用 unique_lock 管理互斥锁，以等待任务
-                    std::unique_lock<std::mutex> lock(this->queueMutex_);
-                    
-                    // 等待条件：线程池被停止 或 任务队列不为空
-                    this->condition_.wait(lock, [this] { 
-                        return this->stop_.load() || !this->tasks_.empty(); 
-                    });
-                    
-                    // 如果线程池停止了，并且任务队列也空了，那么工作线程就可以安全退出了
-                    if (this->stop_.load() && this->tasks_.empty()) {
-                        return;
-                    }
-                    
-                    // 从队列中取出一个任务来执行
-                    task = std::move(this->tasks_.front());
-                    this->tasks_.pop();
-                } // 锁在此处自动释放
-                
-                // 执行任务
-                task();
+        workers_.emplace_back([this] { workerLoop(); });
+    }
+}
+
+// 每个工作线程的执行逻辑：先自旋，再休眠
+inline void ThreadPool::workerLoop() {
+    std::function<void()> task;
+    for (;;) {
+        // 自旋阶段：任务密集时避免进入内核休眠/唤醒
+        bool got = false;
+        for (int spin = 0; spin < kSpinCount; ++spin) {
+            if (tasks_.tryPop(task)) {
+                got = true;
+                break;
             }
+            if (stop_.load(std::memory_order_acquire)) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+
+        if (got) {
+            // 执行任务
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        // 休眠阶段：先登记为休眠者，再检查队列，与 enqueue 中的"先入队再检查休眠者"配对，
+        // 保证要么生产者看到休眠者并唤醒，要么本线程看到新任务，不会丢失唤醒
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        condition_.wait(lock, [this] {
+            return stop_.load() || !tasks_.empty();
         });
+        sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+
+        // 如果线程池停止了，并且任务队列也空了，那么工作线程就可以安全退出了
+        if (stop_.load() && tasks_.empty()) {
+            return;
+        }
     }
 }
 
 // 提交任务的实现
 template<class F>
 bool ThreadPool::enqueue(F&& task) {
-    {
-        std::unique_lock<std::mutex> lock(queueMutex_);
-
-        // 如果线程池已经停止，或者任务队列已达到容量上限，则拒绝新任务
-        if (stop_.load() || tasks_.size() >= queueCapacity_) {
-            return false;
-        }
+    // 如果线程池已经停止，或者任务队列已达到容量上限，则拒绝新任务
+    if (stop_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    if (!tasks_.tryPush(std::function<void()>(std::forward<F>(task)))) {
+        return false;
+    }
 
-        // 将任务放入队列
-        // 使用 std::forward 完美转发任务
-        tasks_.emplace(std::forward<F>(task));
+    // 任务成功入队后，只有存在休眠的工作线程时才需要加锁唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        condition_.notify_one();
     }
-    
-    // 任务成功入队后，通知一个正在等待的工作线程
-    condition_.notify_one();
     return true;
 }
 
 // 析构函数实现
 inline ThreadPool::~ThreadPool() {
+    stop();
+}
+
+inline void ThreadPool::stop() {
     {
-        std::unique_lock<std::mutex> lock(queueMutex_);
+        std::unique_lock<std::mutex> lock(sleepMutex_);
         // 设置停止标志
         stop_.store(true);
     }
@@ -107,7 +132,18 @@ inline ThreadPool::~ThreadPool() {
     
     // 等待所有工作线程执行完剩余任务并安全退出
     for (std::thread &worker : workers_) {
-        worker.join();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // enqueue 检查 stop_ 与入队之间不加锁：生产者可能在工作线程看到"已停止且队列为空"退出之后
+    // 才把任务放入队列。工作线程全部退出后在这里执行这些任务，已接受的任务不会丢失；
+    // 在 stop() 返回之后才入队的任务由析构函数中再次调用的 stop() 执行
+    std::function<void()> task;
+    while (tasks_.tryPop(task)) {
+        task();
+        task = nullptr;
     }
 }
 
@@ -0,0 +1,219 @@
+#ifndef BINARYPROTO_H
+#define BINARYPROTO_H
+
+// server和client共用的二进制聊天消息编码
+//
+// 帧布局（仅用于 ONE_CHAT_MSG / GROUP_CHAT_MSG，其余消息仍使用JSON）：
+//   固定头 24 字节，多字节整数均为网络字节序
+//     magic(1) version(1) msgid(2) from(8) to(8) groupid(4)
+//   变长体：name、time、msg 依次为 varint长度 + 原始UTF-8字节
+// JSON帧总是以'{'开头，二进制帧以 kBinaryMagic 开头，据此区分两种编码
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <arpa/inet.h>
+#include "json.hpp"
+#include "public.hpp"
+
+namespace binaryproto
+{
+
+const uint8_t kBinaryMagic = 0xCB;
+const uint8_t kBinaryVersion = 1;
+const size_t kFixedHeaderLen = 24;
+
+// 聊天消息的结构化表示
+struct ChatMessage
+{
+    int msgid = 0;
+    long long fromId = 0;
+    long long toId = 0;
+    int groupId = 0;
+    std::string name;
+    std::string time;
+    std::string msg;
+};
+
+inline bool isBinary(const std::string &frame)
+{
+    return !frame.empty() && static_cast<uint8_t>(frame[0]) == kBinaryMagic;
+}
+
+inline void putUint16(std::string &out, uint16_t v)
+{
+    v = htons(v);
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+inline void putUint32(std::string &out, uint32_t v)
+{
+    v = htonl(v);
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+inline void putUint64(std::string &out, uint64_t v)
+{
+    putUint32(out, static_cast<uint32_t>(v >> 32));
+    putUint32(out, static_cast<uint32_t>(v));
+}
+
+inline void putVarint(std::string &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline void putBytes(std::string &out, const std::string &bytes)
+{
+    putVarint(out, bytes.size());
+    out.append(bytes);
+}
+
+inline uint16_t getUint16(const char *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+inline uint32_t getUint32(const char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+inline uint64_t getUint64(const char *p)
+{
+    return (static_cast<uint64_t>(getUint32(p)) << 32) | getUint32(p + 4);
+}
+
+// 从 [*p, end) 读取一个varint，成功时推进 *p
+inline bool getVarint(const char **p, const char *end, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(*(*p)++);
+        v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool getBytes(const char **p, const char *end, std::string &bytes)
+{
+    uint64_t len = 0;
+    if (!getVarint(p, end, len) || len > static_cast<uint64_t>(end - *p))
+    {
+        return false;
+    }
+    bytes.assign(*p, len);
+    *p += len;
+    return true;
+}
+
+inline std::string encode(const ChatMessage &m)
+{
+    std::string out;
+    out.reserve(kFixedHeaderLen + m.name.size() + m.time.size() + m.msg.size() + 6);
+    out.push_back(static_cast<char>(kBinaryMagic));
+    out.push_back(static_cast<char>(kBinaryVersion));
+    putUint16(out, static_cast<uint16_t>(m.msgid));
+    putUint64(out, static_cast<uint64_t>(m.fromId));
+    putUint64(out, static_cast<uint64_t>(m.toId));
+    putUint32(out, static_cast<uint32_t>(m.groupId));
+    putBytes(out, m.name);
+    putBytes(out, m.time);
+    putBytes(out, m.msg);
+    return out;
+}
+
+inline bool decode(const std::string &frame, ChatMessage &m)
+{
+    if (frame.size() < kFixedHeaderLen || !isBinary(frame) ||
+        static_cast<uint8_t>(frame[1]) != kBinaryVersion)
+    {
+        return false;
+    }
+
+    const char *p = frame.data() + 2;
+    const char *end = frame.data() + frame.size();
+    m.msgid = getUint16(p);
+    m.fromId = static_cast<long long>(getUint64(p + 2));
+    m.toId = static_cast<long long>(getUint64(p + 10));
+    m.groupId = static_cast<int>(getUint32(p + 18));
+    p = frame.data() + kFixedHeaderLen;
+
+    // 只有聊天消息有二进制编码，其余消息的字段无法由固定布局表示
+    if (m.msgid != ONE_CHAT_MSG && m.msgid != GROUP_CHAT_MSG)
+    {
+        return false;
+    }
+
+    return getBytes(&p, end, m.name) && getBytes(&p, end, m.time) && getBytes(&p, end, m.msg);
+}
+
+// 从JSON聊天消息中提取字段，非聊天消息或字段不全时返回false
+inline bool fromJson(const nlohmann::json &js, ChatMessage &m)
+{
+    if (!js.contains("msgid") || !js.contains("id") || !js.contains("name") ||
+        !js.contains("time") || !js.contains("msg"))
+    {
+        return false;
+    }
+
+    m.msgid = js["msgid"].get<int>();
+    if (m.msgid == ONE_CHAT_MSG && js.contains("toid"))
+    {
+        m.toId = js["toid"].get<long long>();
+        m.groupId = 0;
+    }
+    else if (m.msgid == GROUP_CHAT_MSG && js.contains("groupid"))
+    {
+        m.toId = 0;
+        m.groupId = js["groupid"].get<int>();
+    }
+    else
+    {
+        return false;
+    }
+
+    m.fromId = js["id"].get<long long>();
+    m.name = js["name"].get<std::string>();
+    m.time = js["time"].get<std::string>();
+    m.msg = js["msg"].get<std::string>();
+    return true;
+}
+
+// 还原为与JSON编码完全一致的消息对象，业务层无需区分编码
+inline nlohmann::json toJson(const ChatMessage &m)
+{
+    nlohmann::json js;
+    js["msgid"] = m.msgid;
+    js["id"] = m.fromId;
+    js["name"] = m.name;
+    if (m.msgid == GROUP_CHAT_MSG)
+    {
+        js["groupid"] = m.groupId;
+    }
+    else
+    {
+        js["toid"] = m.toId;
+    }
+    js["msg"] = m.msg;
+    js["time"] = m.time;
+    return js;
+}
+
+} // namespace binaryproto
+
+#endif // BINARYPROTO_H
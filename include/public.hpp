@@ -18,7 +18,9 @@ enum EnMsgType
     HEARTBEAT_MSG ,   //用户心跳信息
     ADD_FRIEND_MSG_ACK,
     CREATE_GROUP_MSG_ACK,
-    ADD_GROUP_MSG_ACK
+    ADD_GROUP_MSG_ACK,
+    OFFLINE_MSG_PAGE,     // 离线消息分页：登录后逐页下发 {"msgs":[...],"lastid":N,"more":bool}
+    OFFLINE_MSG_PAGE_ACK  // 离线消息确认：{"id":userid,"lastid":N}，服务器删除已确认的消息并下发下一页
 };
 
 enum ErrorCode
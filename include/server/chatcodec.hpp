@@ -0,0 +1,67 @@
+#ifndef CHATCODEC_H
+#define CHATCODEC_H
+
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/Buffer.h>
+#include <string>
+#include <cstdint>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// 消息分帧编解码器
+// 解决TCP粘包/半包问题：每次读回调从Buffer中取出所有完整的帧，
+// 不完整的帧保留在Buffer中，等待后续数据到达
+class ChatCodec
+{
+public:
+    // 帧格式
+    enum FrameMode
+    {
+        LENGTH_HEADER,  // 4字节网络字节序长度头 + 消息体
+        LINE_DELIMITED  // 兼容模式：以'\n'分隔的JSON文本
+    };
+
+    // 从Buffer中提取一帧的结果
+    enum DecodeResult
+    {
+        FRAME_OK,         // 取出了一个完整的帧
+        FRAME_INCOMPLETE, // 数据不足一帧，等待后续数据
+        FRAME_INVALID     // 帧长度非法，连接应当被关闭
+    };
+
+    static const size_t kHeaderLen = sizeof(int32_t);
+    // 单帧最大长度，防止恶意的长度头耗尽内存
+    static const int32_t kMaxFrameLen = 16 * 1024 * 1024;
+
+    explicit ChatCodec(FrameMode mode = LENGTH_HEADER) : _mode(mode) {}
+
+    void setMode(FrameMode mode) { _mode = mode; }
+    FrameMode getMode() const { return _mode; }
+
+    // 从buffer中取出一个完整的帧放入frame，只在返回FRAME_OK时消费buffer中的数据
+    DecodeResult retrieveFrame(Buffer *buffer, std::string &frame) const;
+
+    // 按当前帧格式封装消息并发送，需在conn所属的I/O线程中调用
+    void send(const TcpConnectionPtr &conn, const std::string &message) const;
+
+    // 按当前帧格式封装消息，得到可以直接写入套接字的完整帧
+    // 同一条消息发给多个连接时只封装一次，再逐个 sendFrame
+    std::string encode(const std::string &message) const;
+
+    // 发送 encode 得到的完整帧：I/O线程中直接从 frame 写套接字，
+    // 只有一次写不完的部分才拷贝进连接的输出缓冲区。需在conn所属的I/O线程中调用
+    void sendFrame(const TcpConnectionPtr &conn, const std::string &frame) const
+    {
+        conn->send(frame.data(), static_cast<int>(frame.size()));
+    }
+
+    // 发送已经写在 body 中的消息：就地补上帧头或换行后整体发出，不再拷贝消息体
+    // body 的预留空间需至少 kHeaderLen 字节（新建的 Buffer 满足），需在conn所属的I/O线程中调用
+    void send(const TcpConnectionPtr &conn, Buffer *body) const;
+
+private:
+    FrameMode _mode;
+};
+
+#endif // CHATCODEC_H
@@ -0,0 +1,37 @@
+#ifndef CHATPAYLOAD_H
+#define CHATPAYLOAD_H
+
+#include <memory>
+#include <string>
+#include "json.hpp"
+#include "binaryproto.hpp"
+#include "chatcodec.hpp"
+
+// 一次序列化、多处共享的只读聊天消息负载
+// 群聊扇出时所有本地发送、离线存储和Redis转发都引用同一份数据，只增加引用计数
+struct ChatPayload
+{
+    std::string json;   // JSON文本：离线消息和跨服务器转发使用
+    std::string binary; // 二进制编码，为空表示该消息不支持二进制
+    // 按连接的帧格式封装好的完整帧：本地发送直接从这里写套接字，每个接收者不再拷贝消息
+    std::string jsonFrame;
+    std::string binaryFrame; // 协商了二进制的连接使用，为空表示不支持
+};
+using ChatPayloadPtr = std::shared_ptr<const ChatPayload>;
+
+// 将聊天消息序列化为共享负载，jsonText 为已有的JSON文本（为空时由 js 生成）
+inline ChatPayloadPtr makeChatPayload(const ChatCodec &codec, const nlohmann::json &js,
+                                      std::string jsonText = std::string())
+{
+    auto payload = std::make_shared<ChatPayload>();
+    payload->json = jsonText.empty() ? js.dump() : std::move(jsonText);
+    payload->jsonFrame = codec.encode(payload->json);
+    binaryproto::ChatMessage message;
+    if (binaryproto::fromJson(js, message)) {
+        payload->binary = binaryproto::encode(message);
+        payload->binaryFrame = codec.encode(payload->binary);
+    }
+    return payload;
+}
+
+#endif // CHATPAYLOAD_H
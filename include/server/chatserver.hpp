@@ -27,6 +27,11 @@ private:
                    muduo::net::Buffer *buffer,
                    muduo::Timestamp time);
 
+    // 处理一个完整的消息帧：反序列化并投递到业务线程池
+    void onFrame(const TcpConnectionPtr &conn,
+                 const std::string &frame,
+                 Timestamp time);
+
 
 	TcpServer _server;  
 	EventLoop *_loop;
@@ -3,8 +3,12 @@
 
 #include <muduo/net/TcpConnection.h>
 #include <unordered_map>
+#include <vector>
+#include <deque>
 #include <functional>
 #include <mutex>
+#include <atomic>
+#include <any>
 #include "json.hpp"
 #include "usermodel.hpp"
 #include "offlinemessagemodel.hpp"
@@ -14,12 +18,44 @@
 #include "RedisStateStorage.hpp"
 #include <set>
 #include <unordered_set>
-#include "ThreadPool.hpp"
+#include "ShardedExecutor.hpp"
+#include "chatcodec.hpp"
+#include "chatpayload.hpp"
+#include "userconnregistry.hpp"
+#include "presencecache.hpp"
+#include "peermesh.hpp"
+#include "writebehindqueue.hpp"
+#include "usercache.hpp"
 
 using json = nlohmann::json;
 using namespace muduo;
 using namespace muduo::net;
 
+// 连接上下文：连接建立时在 I/O 线程中绑定到 TcpConnection，之后不再替换，任何线程都可以读取
+// userId 和 binaryWire 只在连接的 I/O 线程中写入（登录成功时），其余字段只在 I/O 线程中访问
+struct ChatSession
+{
+    std::atomic<long long> userId{-1}; // 未登录时为 -1
+    // 是否协商使用二进制编码收发聊天消息（见 binaryproto.hpp）
+    std::atomic<bool> binaryWire{false};
+
+    // 登录请求处理期间到达的帧暂存在这里，登录完成后再按新的分片提交，保证在登录之后处理
+    bool loginPending = false;
+    std::vector<std::pair<json, Timestamp>> deferred;
+
+    // 已下发、尚未确认的离线消息页中最后一条的ID，没有在途的页时为 -1
+    // 客户端的确认不能越过它，否则会删掉从未下发的离线消息
+    std::atomic<long long> offlinePageLastId{-1};
+};
+using ChatSessionPtr = std::shared_ptr<ChatSession>;
+
+// 取连接绑定的会话，连接尚未建立完成时返回 nullptr
+inline ChatSession* getSession(const TcpConnectionPtr &conn)
+{
+    const ChatSessionPtr* session = std::any_cast<ChatSessionPtr>(&conn->getContext());
+    return session != nullptr ? session->get() : nullptr;
+}
+
 // 回调函数类型
 using MsgHandler = std::function<void(const TcpConnectionPtr&, json&, Timestamp)>;
 
@@ -33,9 +69,24 @@ public:
         static ChatService service;
         return &service;
     }
-     void init(const std::string& server_id);
+     void init(const std::string& server_id, ChatCodec::FrameMode frame_mode = ChatCodec::LENGTH_HEADER,
+               RedisStateStorage::PresenceMode presence_mode = RedisStateStorage::PER_USER_TTL,
+               RedisPub::Transport transport = RedisPub::PUBSUB,
+               const std::string& mesh_addr = "", const std::string& journal_path = "");
+
+     // 停止服务时、main 返回之前调用（此时数据库连接池等静态对象仍然存活）：
+     // 依次停止消息来源、各执行器，最后刷出写回队列；可重复调用，析构函数也会调用
+     void shutdown();
+
+     // 获取按用户分片的业务执行器
+     ShardedExecutor* getExecutor();
 
-     ThreadPool* getThreadPool();
+     // 获取消息分帧编解码器，网络模块和业务模块共用同一种帧格式
+     ChatCodec* getCodec();
+
+     // 把一条已解码的消息提交到业务执行器，需在 conn 所属的 I/O 线程中调用
+     // 已登录的连接按用户ID分片，未登录的按连接分片；登录处理期间到达的消息暂存到登录完成
+     void dispatch(const TcpConnectionPtr &conn, json &js, Timestamp time);
 
     // 登录业务
     void loginHandler(const TcpConnectionPtr &conn, json &js, Timestamp time);
@@ -63,31 +114,127 @@ public:
     void redis_subscribe_message_handler(const string& channel, const string& message);
 
     void logoutHandler(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    // 离线消息分页确认
+    void offlineMsgAckHandler(const TcpConnectionPtr &conn, json &js, Timestamp time);
 
 private:
     ChatService();
+    ~ChatService();
+
+    // 按目标连接协商的编码发送聊天消息，需在conn所属的I/O线程中调用
+    void sendChatMessage(const TcpConnectionPtr &conn, const ChatPayload &payload);
+
+    // 把同一条消息发给一批本地连接：按连接所属的 EventLoop 分桶，
+    // 每个 loop 只投递一个发送所有连接的任务，减少跨线程唤醒
+    void fanOut(std::vector<TcpConnectionPtr> &conns, const ChatPayloadPtr &payload);
+    // 在数据库执行器中执行 query，结果交给 done 在业务执行器的 key 分片中继续处理
+    // 业务线程只负责投递，不再阻塞在 MySQL 往返上
+    template<class Query, class Done>
+    void runDbAsync(size_t key, Query query, Done done);
+    // 在 Redis 线程的回调中把后续处理提交到业务执行器的 key 分片，分片已满时稍后重试
+    void postFromRedis(size_t key, std::function<void()> task);
+    // 在数据库执行器中执行不需要结果的写操作
+    template<class Write>
+    void postDbWrite(size_t key, Write write);
+
+    // 单聊路由的发送者顺序：同一发送者（分片键）的消息按提交顺序发出。
+    // 有 Redis 查询未完成时，后续消息即使命中本地连接或缓存也排队，查询完成后按顺序依次发出。
+    // 以下方法都在 key 对应的业务分片线程中调用
+    struct PendingRoute
+    {
+        bool ready = false;
+        std::function<void()> route;
+    };
+    // 没有未完成的查询时直接执行 route，否则排在队尾
+    void routeInOrder(size_t key, std::function<void()> route);
+    // 为一次异步查询占位，查询结果交给 completeRoute
+    std::shared_ptr<PendingRoute> beginRoute(size_t key);
+    // 填入占位的路由，并执行队首所有已就绪的路由
+    void completeRoute(size_t key, const std::shared_ptr<PendingRoute> &entry, std::function<void()> route);
+
+    // 群聊第二阶段：按成员所在位置本地发送、跨服务器转发或存储离线消息
+    void deliverGroupChat(long long userId, int groupId, const ChatPayloadPtr &payload,
+                          std::vector<long long> &userIdVec);
+
+    // 登录成功后在数据库线程中加载的用户数据
+    struct LoginData
+    {
+        std::vector<Group> groups;
+        std::vector<OfflineMsg> offlinePage; // 第一页离线消息
+        std::vector<User> friends;
+    };
+    // 登录请求处理结束（userId 为 -1 表示失败）：在 conn 的 I/O 线程中写入会话、
+    // 把连接登记到 _userConns，再提交登录期间暂存的消息
+    void resumeSession(const TcpConnectionPtr &conn, long long userId, bool binaryWire);
+    // 登录第二阶段：用已加载的数据填充群组缓存、查询在线状态并发送登录应答
+    void finishLogin(const TcpConnectionPtr &conn, const User &user, bool binaryWire, LoginData &data);
+    // 存储离线消息：优先进入写回队列
+    void storeOfflineMsg(long long userId, const std::string &msg);
+    // 下发一页离线消息，按字节数上限截断，客户端确认后再下发下一页
+    void sendOfflinePage(const TcpConnectionPtr &conn, std::vector<OfflineMsg> &page);
+    // 用户下线后从本地群组缓存中移除
+    void removeFromGroupCache(long long userId, const std::vector<int> &groupIds);
+
+    // 广播用户登录/下线事件，各服务器据此失效本地在线状态缓存
+    void publishPresenceEvent(const std::string &event, long long userId);
+    void handlePresenceEvent(const std::string &message);
+
     ChatService(const ChatService&) = delete;
     ChatService& operator=(const ChatService&) = delete;
 
     // 存储消息id和其对应的业务处理方法
     std::unordered_map<int, MsgHandler> _msgHandlerMap;
     
-    // 存储在线用户的通信连接
-    std::unordered_map<long long, TcpConnectionPtr> _userConnMap;
+    // 存储在线用户的通信连接（分片加锁，线程安全）
+    UserConnRegistry _userConns;
 
     //
     std::unordered_map<int, std::unordered_set<long long>> _localGroupCache;
     // 定义互斥锁
-    std::mutex _connMutex;
-
     std::mutex _groupCacheMutex;
 
 
+    // 异步Redis客户端（专用 EventLoop 线程），供下面两个对象共用
+    // 声明在它们之前，保证最后析构
+    std::unique_ptr<AsyncRedisClient> _asyncRedis;
+
     //redis操作对象
     RedisPub _redis;
     std::unique_ptr<RedisStateStorage> _RedisStateStorage;
 
-    std::unique_ptr<ThreadPool> _threadPool;
+    // 服务器直连网格：跨服务器的批量帧优先经直连链路发送，链路不可用时走 Redis
+    // 依赖 _RedisStateStorage 登记地址，由析构函数先于 _redis 释放
+    std::unique_ptr<PeerMesh> _mesh;
+
+    // 其他服务器上在线用户的本地缓存，减少单聊路由对Redis的查询
+    PresenceCache _presenceCache;
+
+    // 有未完成查询的发送者的路由队列，见 routeInOrder
+    std::unordered_map<size_t, std::deque<std::shared_ptr<PendingRoute>>> _pendingRoutes;
+    std::mutex _routeMutex;
+
+    // 用户资料缓存（含不存在用户的负缓存），登录认证通常不再查询MySQL
+    UserCache _userCache;
+
+    // 写回队列：离线消息、好友和群成员关系的写入在这里合并后批量落库
+    // 由 shutdown 在所有执行器排空之后才停止，执行器剩余任务的写入仍能入队
+    std::unique_ptr<WriteBehindQueue> _writeBehind;
+
+    // 业务执行器：同一用户的消息落在同一分片，按到达顺序处理
+    std::unique_ptr<ShardedExecutor> _executor;
+
+    // 数据库执行器：模型操作在专用的数据库线程中执行，完成后投递回业务执行器
+    // 同样按用户分片，同一用户的数据库操作按提交顺序执行
+    // 各执行器不依赖析构顺序：shutdown 按 投递 -> 业务 -> 数据库 的顺序排空，
+    // 上游剩余任务提交的下游任务仍能执行；下游停止后的提交退回在调用线程中同步执行
+    std::unique_ptr<ShardedExecutor> _dbExecutor;
+
+    // 跨服务器消息的投递执行器：Redis 订阅线程只读取和解包，
+    // 消息按目标用户/群组分片投递，一个慢的群聊扇出不会阻塞其他入站消息
+    std::unique_ptr<ShardedExecutor> _deliveryExecutor;
+
+    // 消息分帧编解码器
+    ChatCodec _codec;
 
     // 数据操作类对象
     UserModel _userModel;
@@ -96,6 +243,8 @@ private:
     GroupModel _groupModel;
 
     std::string my_server_id="localServer";
+
+    bool _shutdown = false;
 };
 
 #endif // CHATSERVICE_H
\ No newline at end of file
@@ -12,10 +12,61 @@
 #include <atomic>   // for std::atomic
 #include <thread>   // for std::thread
 #include <chrono>   // for time points
+#include <vector>
+#include <unordered_map>
+#include <type_traits>
 
 using namespace std;
 
-// MySQL 包装类 (不变)
+// MySQL 的布尔类型：MySQL 8.0 使用 bool，5.7/MariaDB 使用 my_bool
+using mysql_bool = std::remove_pointer_t<decltype(MYSQL_BIND::is_null)>;
+
+// 预处理语句
+// 由 MySQL::prepare 创建并缓存在所属的连接上，同一连接上重复执行时免去SQL解析
+// 参数和结果都走二进制协议，消息体长度不再受固定大小的SQL缓冲区限制
+class PreparedStatement
+{
+public:
+    explicit PreparedStatement(MYSQL_STMT *stmt);
+    ~PreparedStatement();
+
+    PreparedStatement(const PreparedStatement&) = delete;
+    PreparedStatement& operator=(const PreparedStatement&) = delete;
+
+    // 绑定参数，index 从 0 开始，对应 SQL 中第 index+1 个 '?'
+    void bindInt(int index, int value);
+    void bindInt64(int index, long long value);
+    // 字符串参数只保存指针，value 必须在 execute/query 返回前保持有效
+    void bindString(int index, const string &value);
+
+    // 执行 INSERT/UPDATE/DELETE
+    bool execute();
+    // 执行查询并取回所有结果行，每列以字符串返回，NULL 列为空串
+    bool query(vector<vector<string>> &rows);
+
+    unsigned long long insertId() const;
+    unsigned long long affectedRows() const;
+
+    // 执行失败后语句可能已失效（例如连接断开），由连接负责重新预处理
+    bool valid() const { return _valid; }
+
+    // 最近一次执行失败是否因为服务器拒绝了语句或数据本身（如数据过长、约束冲突），
+    // 而不是连接断开、锁超时等暂时性错误；被拒绝的数据原样重试不会成功
+    bool rejected() const;
+
+private:
+    bool bindAndExecute();
+
+    MYSQL_STMT *_stmt;
+    bool _valid;
+    unsigned int _errno; // 最近一次执行失败的错误码，成功时为 0
+    vector<MYSQL_BIND> _params;
+    vector<long long> _intValues;
+    vector<unsigned long> _lengths;
+};
+
+// MySQL 包装类
+// 与连接池中的一条物理连接一一对应，随连接在池中复用，并缓存该连接上的预处理语句
 class MySQL
 {
 public:
@@ -25,8 +76,12 @@ public:
     MYSQL_RES *query(string sql);
     MYSQL* getConnection() const;
 
+    // 获取 sql 对应的预处理语句，首次使用时在本连接上预处理并缓存，失败返回 nullptr
+    PreparedStatement *prepare(const string &sql);
+
 private:
     MYSQL *_conn;
+    unordered_map<string, unique_ptr<PreparedStatement>> _statements;
 };
 
 // 数据库连接池类 (单例)
@@ -43,6 +98,9 @@ private:
     ConnectionPool& operator=(const ConnectionPool&) = delete;
 
     bool loadConfigFile();
+
+    // 创建一条新的物理连接，失败返回 nullptr
+    MySQL* createConnection();
     
     // 新增的后台线程任务函数
     void produceConnectionTask();
@@ -59,8 +117,9 @@ private:
     int _maxIdleTime;
     int _connectionTimeout;
 
-    // 队列中存放 MYSQL* 和其进入空闲状态的时间点
-    queue<pair<MYSQL*, chrono::steady_clock::time_point>> _connectionQueue; 
+    // 队列中存放 MySQL* 和其进入空闲状态的时间点
+    // MySQL 对象随物理连接一起复用，预处理语句缓存因此跨借用保留
+    queue<pair<MySQL*, chrono::steady_clock::time_point>> _connectionQueue; 
     mutex _queueMutex;
     condition_variable _cv;
     condition_variable _producer;
@@ -2,6 +2,7 @@
 #define FRIENDMODEL_H
 #include "user.hpp"
 #include <vector>
+#include <utility>
 
 // 维护好友信息的操作接口方法
 class FriendModel
@@ -10,6 +11,11 @@ public:
     // 添加好友关系
     void insert(long long userId, long long friendId);
 
+    // 批量添加好友关系（写回队列使用），每行为 (userId, friendId)，已存在的关系忽略
+    // 按顺序分组执行，遇到失败即停止，返回已成功写入的行数
+    // rejected 非空时，因服务器拒绝数据本身而停止时置为 true（见 PreparedStatement::rejected）
+    size_t insertBatch(const std::vector<std::pair<long long, long long>> &rows, bool *rejected = nullptr);
+
     // 返回用户好友列表
     std::vector<User> query(long long userId);
 };
@@ -5,6 +5,14 @@
 #include <string>
 #include <vector>
 
+// 一条群成员关系，批量加入群组时使用
+struct GroupMemberRow
+{
+    long long userid;
+    int groupid;
+    std::string role;
+};
+
 class GroupModel
 {
 public:
@@ -12,8 +20,14 @@ public:
     bool createGroup(Group &group);
     // 加入群组
     void addGroup(long long userid, int groupid, std::string role);
-    // 查询用户所在群组信息
+    // 批量加入群组（写回队列使用），已存在的成员关系忽略
+    // 按顺序分组执行，遇到失败即停止，返回已成功写入的行数
+    // rejected 非空时，因服务器拒绝数据本身而停止时置为 true（见 PreparedStatement::rejected）
+    size_t addGroupBatch(const std::vector<GroupMemberRow> &rows, bool *rejected = nullptr);
+    // 查询用户所在群组信息（包含群成员），一次联表查询完成
     std::vector<Group> queryGroups(long long userid);
+    // 只查询用户所在群组的id，用于注销/断线时清理本地群组缓存
+    std::vector<int> queryGroupIds(long long userid);
     // 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
     std::vector<long long> queryGroupUsers(long long userid, int groupid);
 
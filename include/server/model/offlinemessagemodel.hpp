@@ -3,20 +3,42 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 using namespace std;
 
+// 一条离线消息及其自增ID，ID 用作分页游标
+struct OfflineMsg
+{
+    long long id;
+    std::string msg; // 服务器序列化好的JSON文本，按不透明字节存储，下发时原样拼接
+};
+
 // 提供离线消息表的操作接口方法
 class OfflineMsgModel
 {
 public:
     // 存储用户的离线消息
-    void insert(long long userId, std::string msg);
+    void insert(long long userId, const std::string &msg);
+
+    // 将同一条消息批量存储给多个用户，合并为多行INSERT，只占用一个数据库连接
+    void insertBatch(const std::vector<long long> &userIds, const std::string &msg);
+
+    // 批量存储各不相同的离线消息（写回队列使用），每行为 (用户ID, 消息)，消息只引用不拷贝
+    // 按顺序分组执行，遇到失败即停止，返回已成功写入的行数
+    // rejected 非空时，因服务器拒绝数据本身而停止时置为 true（见 PreparedStatement::rejected）
+    size_t insertRows(const std::vector<std::pair<long long, const std::string*>> &rows, bool *rejected = nullptr);
 
     // 删除用户的离线消息
     void remove(long long userId);
 
+    // 删除用户 ID 不大于 maxId 的离线消息（客户端已确认收到）
+    void removeUpTo(long long userId, long long maxId);
+
     // 查询用户的离线消息
     std::vector<std::string> query(long long userId);
+
+    // 按ID升序分页查询用户 ID 大于 afterId 的离线消息，最多 limit 条
+    std::vector<OfflineMsg> queryPage(long long userId, long long afterId, int limit);
 };
 
 #endif // OFFLINE_MESSAGE_MODEL_H
\ No newline at end of file
@@ -12,6 +12,10 @@ public:
     // 根据用户号码查询用户信息
     User query(long long id);
 
+    // 同上，但区分"用户不存在"和"查询失败"：查询成功返回 true（用户不存在时 user 的 id 为 -1），
+    // 数据库出错返回 false，调用方据此避免把一次故障缓存成"用户不存在"
+    bool query(long long id, User &user);
+
     // 更新用户的状态信息
     bool updateState(User user);
 
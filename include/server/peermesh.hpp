@@ -0,0 +1,90 @@
+#ifndef PEERMESH_H
+#define PEERMESH_H
+
+#include <muduo/net/TcpServer.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <unordered_map>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include "chatcodec.hpp"
+#include "RedisStateStorage.hpp"
+
+using namespace muduo;
+using namespace muduo::net;
+
+// 服务器之间的直连网格
+// 每台服务器监听一个网格端口，并把 "host:port" 登记到 Redis；
+// 发往其他服务器的批量帧优先经由到该服务器的长连接直接发送，不再经过 Redis 转发；
+// 链路尚未建立时 ready 返回 false，已交给网格的帧遇到链路断开时由 send 的回调交还调用方改走 Redis。
+// 网格只负责单向投递帧：入站帧交给 FrameHandler，出站链路上不会收到数据。
+// 出站链路建立后先发送携带本机服务器ID的握手帧，入站连接在握手之前发来的帧一律拒绝并断开。
+// 与 pub/sub 一样不保证送达：已写入套接字、对端尚未读取的帧在链路断开时丢失。
+// 所有监听和出站连接都运行在一个专用的 EventLoop 线程中。
+class PeerMesh
+{
+public:
+    // 收到其他服务器发来的一帧，在网格线程中回调
+    using FrameHandler = std::function<void(const char *data, size_t len)>;
+    // send 的结果：sent 为 false 表示链路已断开，帧没有写出
+    using SendDone = std::function<void(bool sent)>;
+
+    // advertiseAddr: 其他服务器连接本机使用的 "host:port"，本机在该端口的所有地址上监听
+    PeerMesh(const std::string &serverId, const std::string &advertiseAddr, RedisStateStorage *storage);
+    ~PeerMesh();
+
+    PeerMesh(const PeerMesh&) = delete;
+    PeerMesh& operator=(const PeerMesh&) = delete;
+
+    // 启动网格线程、开始监听并登记地址
+    bool start(FrameHandler handler);
+
+    // 到 serverId 的链路是否已建立，可在任意线程调用；未建立时在后台查询地址、建立链路
+    bool ready(const std::string &serverId);
+
+    // 经直连链路向 serverId 发送一帧，可在任意线程调用
+    // 帧在网格线程中按提交顺序处理：写出后以 true 回调 done，链路已断开时以 false 回调
+    void send(const std::string &serverId, const std::string &frame, SendDone done);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct PeerLink
+    {
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr conn;         // 已连接时非空
+        bool resolving = false;        // 正在查询对端地址
+        Clock::time_point retryAfter;  // 对端未登记地址时，这之前不再查询
+    };
+
+    void connectPeerInLoop(const std::string &serverId, const std::string &address);
+    void onPeerConnection(const std::string &serverId, const TcpConnectionPtr &conn);
+    void onInboundMessage(const TcpConnectionPtr &conn, Buffer *buffer, Timestamp);
+    // 入站连接的第一帧必须是握手帧，校验通过后在连接上下文中记下对端服务器ID
+    bool acceptHello(const TcpConnectionPtr &conn, const std::string &frame);
+    void runInLoopAndWait(const std::function<void()> &fn);
+
+    // 解析 "host:port"，失败返回 false
+    static bool parseAddress(const std::string &address, std::string &host, uint16_t &port);
+
+    std::string _serverId;
+    std::string _advertiseAddr;
+    RedisStateStorage *_storage; // 不持有
+
+    EventLoopThread _loopThread;
+    EventLoop *_loop;
+    std::unique_ptr<TcpServer> _server;
+
+    // 网格链路上的帧格式固定为长度头
+    ChatCodec _codec;
+    FrameHandler _handler;
+
+    std::mutex _mutex;
+    std::unordered_map<std::string, PeerLink> _peers;
+};
+
+#endif // PEERMESH_H
@@ -0,0 +1,72 @@
+#ifndef PRESENCECACHE_H
+#define PRESENCECACHE_H
+
+#include <unordered_map>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+// 本地在线状态缓存：用户ID -> 所在服务器ID
+// 只缓存"在其他服务器在线"的查询结果，热点会话的单聊路由因此不必每条消息都查询Redis。
+// 正确性依赖两点：
+//   1. 用户登录/下线时各服务器通过广播通道收到事件并失效对应条目
+//   2. 条目的存活时间很短，兜底覆盖广播丢失或服务器宕机（没有下线事件）的情况
+// 按用户ID分片加锁，每个分片容量有上限，满时先清理过期条目，仍然满则随意淘汰一个
+class PresenceCache
+{
+public:
+    PresenceCache(size_t capacity = 100000, std::chrono::milliseconds ttl = std::chrono::seconds(5));
+
+    // 查询用户所在服务器，未命中或已过期返回 false
+    bool get(long long userId, std::string &serverId);
+
+    // 查询 Redis 之前取得用户的失效版本，查询结果交给 put 时带上
+    uint64_t version(long long userId);
+
+    // 记录用户所在服务器；version 之后该用户的条目被失效过时不写入，
+    // 避免查询期间收到的下线/登录事件被查询前的旧结果覆盖
+    void put(long long userId, const std::string &serverId, uint64_t version);
+
+    // 失效用户的条目
+    void invalidate(long long userId);
+
+private:
+    static const size_t kShardCount = 16; // 必须是2的幂
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        std::string serverId;
+        Clock::time_point expireAt;
+    };
+
+    // 每个分片内按用户ID再分成若干失效版本槽，invalidate 递增所在槽的版本
+    static const size_t kVersionSlots = 256; // 必须是2的幂
+
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<long long, Entry> entries;
+        uint64_t versions[kVersionSlots] = {};
+    };
+
+    static size_t shardIndex(long long userId)
+    {
+        uint64_t h = static_cast<uint64_t>(userId) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(h >> 32) & (kShardCount - 1);
+    }
+
+    static size_t versionSlot(long long userId)
+    {
+        uint64_t h = static_cast<uint64_t>(userId) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(h >> 40) & (kVersionSlots - 1);
+    }
+
+    size_t _shardCapacity;
+    Clock::duration _ttl;
+    Shard _shards[kShardCount];
+};
+
+#endif // PRESENCECACHE_H
@@ -10,22 +10,67 @@
 #include <memory> // For std::shared_ptr
 #include <hiredis/hiredis.h>
 #include <unordered_map>
+#include <functional>
+#include "asyncRedisClient.hpp"
 
 class Connectionguard;
 class RedisStateStorage {
 public:
-    RedisStateStorage(size_t pool_size = 10, const char* ip = "127.0.0.1", int port = 6379);
+    // 在线状态的存储模式
+    enum PresenceMode {
+        PER_USER_TTL,  // 每个用户一个带TTL的key，靠用户心跳续期
+        SERVER_LEASE   // 每台服务器一个租约key，用户->服务器的映射存在一个hash中，
+                       // 服务器租约过期即视为其上的用户全部离线，用户心跳不再写Redis
+    };
+
+    // async_client 不为空时，*Async 接口走异步客户端，否则退化为同步调用
+    RedisStateStorage(size_t pool_size = 10, const char* ip = "127.0.0.1", int port = 6379,
+                      AsyncRedisClient* async_client = nullptr);
     ~RedisStateStorage();
 
     // 禁止拷贝和赋值
     RedisStateStorage(const RedisStateStorage&) = delete;
     RedisStateStorage& operator=(const RedisStateStorage&) = delete;
 
+    // 原子地占有用户的在线状态（登录时使用），代替"先查询再写入"的两次往返
+    // 成功返回 true；用户已在某台服务器在线时返回 false 并把该服务器ID写入 owner；
+    // Redis 出错时返回 false 且 owner 为空
+    bool tryClaimUser(long long user_id, const std::string& server_id, std::string& owner, int ttl_seconds = 60);
+
     bool setUserOnline(const std::string& user_id, const std::string& server_id, int ttl_seconds = 60);
     bool setUserOffline(const std::string& user_id);
     bool getUserStatus(const std::string& user_id, std::string& server_id);
     bool refreshUserTTL(long long user_id, int ttl_seconds = 60);
+    // 批量查询在线状态，返回在线用户 -> 所在服务器；大批量按分块流水线查询
     std::unordered_map<long long, std::string> getUsersStatus(const std::vector<long long>& user_ids);
+
+    // 批量查询时每条 MGET/HMGET 最多包含的 key 数量
+    void setStatusChunkSize(size_t chunk_size) { _status_chunk_size = chunk_size > 0 ? chunk_size : 1; }
+
+    // 切换到服务器租约模式并开始定时续租，需要异步客户端；必须在处理业务之前调用
+    // 登录占有脚本会访问未声明在 KEYS 中的租约key，租约模式不支持 Redis Cluster
+    bool enableServerLease(const std::string& server_id, int lease_ttl_seconds = 15);
+    PresenceMode getPresenceMode() const { return _mode; }
+
+    // 服务器直连网格的地址登记：server_mesh_addrs 中存 服务器ID -> "host:port"
+    bool registerServerAddress(const std::string& server_id, const std::string& address);
+    bool unregisterServerAddress(const std::string& server_id);
+
+    // === 异步接口：不阻塞调用线程，回调在 Redis 线程中执行 ===
+    // 异步查询的结果：Redis 断线或返回错误时为 STATUS_ERROR，不能当作离线处理
+    enum UserStatus {
+        USER_OFFLINE,
+        USER_ONLINE,
+        STATUS_ERROR
+    };
+    using StatusCallback = std::function<void(UserStatus status, const std::string& server_id)>;
+    void getUserStatusAsync(long long user_id, StatusCallback callback);
+    void setUserOfflineAsync(long long user_id);
+    // 查询服务器的直连地址，未登记时回调空串
+    void getServerAddressAsync(const std::string& server_id, std::function<void(const std::string& address)> callback);
+    // 心跳续期：只记录到待续期集合，由 Redis 线程定时批量发出 EXPIRE
+    // 同一用户在一个刷新周期内的多次心跳只续期一次；租约模式下为空操作
+    void refreshUserTTLAsync(long long user_id, int ttl_seconds = 60);
     friend class ConnectionGuard;
 protected:
     // 获取和归还连接的内部方法
@@ -39,6 +84,53 @@ private:
     // 这样才能完美地实现心跳续期功能。
     const std::string _key_prefix = "online_users:";
 
+    // 租约模式：server_lease:<server_id> 表示服务器存活，online_user_server 存 用户ID -> 服务器ID
+    // 映射中的服务器租约已过期的条目视为离线，由该用户下次登录时覆盖；
+    // 服务器以同一ID重启时会先清理自己遗留的条目
+    const std::string _lease_prefix = "server_lease:";
+    const std::string _user_server_key = "online_user_server";
+
+    const std::string _server_addr_key = "server_mesh_addrs";
+
+    // 执行脚本：优先 EVALSHA，脚本未加载（SHA为空或 NOSCRIPT）时退回 EVAL，EVAL 同时会让服务端缓存脚本
+    redisReply* evalScript(redisContext* conn, const char* script, const std::string& sha,
+                           const std::vector<std::string>& keys, const std::vector<std::string>& args);
+    std::string loadScript(const char* script);
+
+    // tryClaimUser 两种在线模式下脚本的SHA，构造时加载，之后只读
+    std::string _claim_ttl_sha;
+    std::string _claim_lease_sha;
+
+    // 租约模式下检查服务器是否存活
+    bool isServerAlive(redisContext* conn, const std::string& server_id);
+    // 删除映射中所有指向 server_id 的条目，启动取得租约前和正常退出时调用
+    bool purgeServerUsers(redisContext* conn, const std::string& server_id);
+    // 对 names 执行 head + names 形式的多值查询（MGET / HMGET key），按 _status_chunk_size 拆分，
+    // 多条命令在同一连接上流水线发送；values[i] 为 names[i] 的值，不存在时为空串
+    bool pipelinedMultiGet(redisContext* conn, const std::vector<std::string>& head,
+                           const std::vector<std::string>& names, std::vector<std::string>& values);
+
+    // 租约模式下的批量查询：一次 HMGET 查出所在服务器，再一次 MGET 检查这些服务器的租约
+    std::unordered_map<long long, std::string> getUsersStatusByLease(redisContext* conn,
+                                                                      const std::vector<long long>& user_ids);
+
+    size_t _status_chunk_size;
+
+    PresenceMode _mode;
+    std::string _lease_server_id;
+    int _lease_ttl;
+    muduo::net::TimerId _lease_renew_timer;
+
+    // 在 Redis 线程中把待续期集合作为一批流水线 EXPIRE 发出
+    void flushPendingTTL();
+
+    AsyncRedisClient* _async; // 不持有，由创建者管理生命周期
+
+    // 待续期的用户及其TTL，心跳线程写入，Redis 线程定时取走
+    std::unordered_map<long long, int> _pending_ttl;
+    std::mutex _ttl_mutex;
+    muduo::net::TimerId _ttl_flush_timer;
+
     size_t _pool_size;
     std::queue<redisContext*> _connections; // 连接队列
     std::mutex _mutex;                      // 互斥锁
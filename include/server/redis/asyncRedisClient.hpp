@@ -0,0 +1,78 @@
+#ifndef ASYNCREDISCLIENT_H
+#define ASYNCREDISCLIENT_H
+
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/Channel.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+// 基于 hiredis 异步接口的 Redis 客户端
+// 连接由一个专用的 muduo EventLoop 线程驱动：命令只写入发送缓冲区即返回，
+// 应答在 Redis 线程中通过回调交付，调用线程不再阻塞等待往返。
+// 单条连接上的命令按提交顺序执行，应答也按同样顺序回调。
+class AsyncRedisClient
+{
+public:
+    // 应答回调，在 Redis 线程中执行；连接断开或命令失败时 reply 为 nullptr
+    // reply 由 hiredis 在回调返回后释放，需要保留的数据必须在回调中拷贝
+    using ReplyCallback = std::function<void(redisReply *reply)>;
+
+    AsyncRedisClient(const std::string &ip = "127.0.0.1", int port = 6379);
+    ~AsyncRedisClient();
+
+    AsyncRedisClient(const AsyncRedisClient&) = delete;
+    AsyncRedisClient& operator=(const AsyncRedisClient&) = delete;
+
+    // 启动 Redis 线程并发起连接，断线后自动重连
+    void start();
+
+    // 异步执行命令，可在任意线程调用；参数按二进制安全方式发送
+    // callback 为空表示不关心应答
+    void command(std::vector<std::string> args, ReplyCallback callback = ReplyCallback());
+
+    // 在 Redis 线程中周期性执行 cb，必须在 start() 之后调用
+    muduo::net::TimerId runEvery(double interval, muduo::net::TimerCallback cb);
+
+    // 取消定时器；从其他线程调用时会等到取消完成才返回，之后回调不会再执行
+    void cancel(muduo::net::TimerId timerId);
+
+    // 在 Redis 线程中执行 fn 并等待其完成；在 Redis 线程中调用时直接执行
+    void runInLoopAndWait(const std::function<void()> &fn);
+
+    // 驱动本客户端的 EventLoop，可用于在 Redis 线程中挂定时器
+    muduo::net::EventLoop *getLoop() const { return _loop; }
+
+private:
+    void connectInLoop();
+    void commandInLoop(const std::vector<std::string> &args, ReplyCallback callback);
+
+    // hiredis 回调
+    static void onConnect(const redisAsyncContext *ctx, int status);
+    static void onDisconnect(const redisAsyncContext *ctx, int status);
+    static void onReply(redisAsyncContext *ctx, void *reply, void *privdata);
+
+    // hiredis 事件适配器：把读写事件的开关映射到 muduo Channel
+    static void addRead(void *privdata);
+    static void delRead(void *privdata);
+    static void addWrite(void *privdata);
+    static void delWrite(void *privdata);
+    static void cleanup(void *privdata);
+
+    std::string _ip;
+    int _port;
+
+    muduo::net::EventLoopThread _loopThread;
+    muduo::net::EventLoop *_loop;
+
+    // 以下成员只在 Redis 线程中访问
+    redisAsyncContext *_context;
+    std::shared_ptr<muduo::net::Channel> _channel;
+    bool _stopping;
+};
+
+#endif
@@ -4,45 +4,196 @@
 #include <hiredis/hiredis.h>
 #include <thread>
 #include <functional>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <chrono>
+#include "asyncRedisClient.hpp"
+#include "ShardedExecutor.hpp"
 
 using namespace std;
 using redis_handler = function<void(string,string)>;
+//直连发送（如服务器网格）：direct_ready 判断到目标服务器的链路是否可用，不可用时在后台建立；
+//direct_sender 把一帧交给链路，写出后以 true 调用 direct_done，链路已断开、帧未写出时以 false 调用
+using direct_done = function<void(bool)>;
+using direct_ready = function<bool(const string&)>;
+using direct_sender = function<void(const string&, const string&, direct_done)>;
+//流消息的确认凭据：由该条流消息解包出的投递任务共同持有，最后一份释放时发送 XACK
+using stream_ack = std::shared_ptr<void>;
 
 class RedisPub
 {
 public:
+    //跨服务器消息的传输方式
+    enum Transport
+    {
+        PUBSUB,  //PUBLISH/SUBSCRIBE：即发即弃，订阅端断线期间的消息会丢失
+        STREAMS  //Redis Streams：每台服务器一个流和同名消费组，投递回调执行完才确认（XACK），
+                 //未确认的消息在重启/重连后重放；至少一次投递，确认发出前退出的消息会重复投递
+    };
+
     RedisPub();
     ~RedisPub();
 
     //连接Redis服务器
     bool connect();
 
+    //设置异步发布客户端（不持有），设置后 publish 只入队不阻塞，也不再与其他线程争用同步上下文
+    void setAsyncPublisher(AsyncRedisClient *client);
+
+    //开启按通道合并发布（需先设置异步发布客户端）：发往同一通道的消息先在本地累积，
+    //定时或累积到 max_batch_bytes 后打包成一帧，用一条 PUBLISH 发出
+    void enableBatching(double flush_interval = 0.002, size_t max_batch_bytes = 64 * 1024);
+
+    //切换到 Streams 接收（需先设置异步发布客户端，并在 enableBatching 之前调用）：本服务器从 "chat_stream:<inbox>" 以消费组批量读取并确认；
+    //broadcast_channels 中的通道（如在线状态事件）仍走 pub/sub
+    //发送方式按目标决定：目标登记为 Streams 接收时 XADD 到 "chat_stream:<目标>"，否则 PUBLISH，
+    //因此同一集群中两种传输方式可以混用
+    bool enableStreams(const string &inbox, const vector<string> &broadcast_channels);
+
+    //在 Redis 中登记本服务器的接收方式（Streams 或 pub/sub），传输方式确定后调用一次
+    void advertiseTransport(const string &inbox);
+
+    //设置直连发送（如服务器网格，需在 enableBatching 之前调用）：发往以 pub/sub 接收的服务器的数据帧在链路可用时直连发送
+    //每个目标同一时刻只用一条路径：Redis 上的帧全部得到应答后才切换到直连，已交给直连链路的帧处理完后才切回 Redis，
+    //链路断开时未写出的帧按原顺序改走 Redis；以 Streams 接收的目标不走直连，保留流的持久化和重放
+    //broadcast_channels 中的通道（如在线状态事件）需要所有服务器收到，始终走 pub/sub
+    void setDirectSender(direct_ready ready, direct_sender sender, const vector<string> &broadcast_channels);
+
+    //上报经其他途径（如直连网格）收到的一帧数据，格式与从 Redis 收到的相同
+    void dispatchInbound(const string &channel, const char *data, size_t len);
+
     //向Redis指定的通道channel发布消息
-    bool publish(string channel, string message);
+    //route_key 为接收端的投递顺序键（如目标用户ID、群组ID），随批量帧一起发送，
+    //接收端同一 route_key 的消息在同一个投递线程中按顺序处理
+    bool publish(const string &channel, const string &message, uint64_t route_key = 0);
+
+    //设置投递执行器（不持有）：订阅线程只负责读取和解包，消息按 route_key 分发到执行器中调用回调
+    //不设置时在订阅线程中直接调用回调
+    void setDeliveryExecutor(ShardedExecutor *executor);
 
     //向Redis指定的通道subscribe订阅消息
     bool subscribe(string hannel);
 
+    //一次订阅多个通道，所有通道的消息由同一个监听线程上报，只能调用一次
+    bool subscribe(const vector<string> &channels);
+
     //取消订阅
     bool unsubscribe(string channel);
 
     //独立线程中接收订阅通道的消息
     void observer_channel_message();
 
+    //停止订阅线程和流消费线程并等待其退出，返回后不会再上报任何消息
+    //投递执行器、回调对象析构之前必须调用；析构函数也会调用
+    void stop();
+
     //初始化业务层上报通道消息的回调对象
     void init_notify_handler(redis_handler handler);
 
 private:
+    //在 Redis 线程中把所有通道累积的消息各自打包发出
+    void flushBatches();
+
+    //订阅端解包：批量帧逐条上报，非批量的消息原样上报
+    //ack 非空时（来自流的消息）由投递任务持有，全部执行完才确认
+    void dispatchMessage(const string &channel, const char *data, size_t len, const stream_ack &ack = nullptr);
+    void deliver(const string &channel, string message, uint64_t route_key, const stream_ack &ack);
+
+    //按目标的接收方式把一帧数据发往通道，可在任意线程调用
+    void sendToChannel(const string &channel, string payload);
+    //经直连链路发送，该目标当前不能走直连时返回 false
+    bool sendDirect(const string &channel, const string &payload);
+    //PUBLISH 一帧；track 为 true 时计入该目标在 Redis 上的在途帧
+    void publishToChannel(const string &channel, string payload, bool track);
+
+    //在 Redis 线程中刷新以 Streams 接收的服务器集合
+    void refreshStreamServers();
+    bool isStreamServer(const string &channel);
+
+    //独立线程中从本服务器的流读取消息：先重放未确认的消息，再阻塞读取新消息
+    void consume_stream_messages();
+    //读取一批流消息并上报，返回读到的条数，出错返回 -1
+    //last_id 为 ">" 时阻塞读取新消息；否则读取该ID之后未确认的消息，并把 last_id 推进到本批最后一条
+    int read_stream_batch(redisContext *context, string &last_id);
+    //为一条流消息生成确认凭据，并登记为在途
+    stream_ack makeStreamAck(const string &id);
+    bool isStreamInflight(const string &id);
+
     //hiredis同步上下文对象，负责publish消息
     redisContext *publish_context_;
 
+    //异步发布客户端，为空时使用 publish_context_
+    AsyncRedisClient *async_publisher_;
+
     //负责subscribe消息
     redisContext *subcribe_context_;
 
     //回调操作，收到消息给service上报
     redis_handler notify_message_handler_;
 
-    std::string subscribe_channel_;
+    //投递执行器，为空时在订阅线程中上报
+    ShardedExecutor *delivery_executor_;
+
+    //直连发送，为空时只走 Redis
+    direct_ready direct_ready_;
+    direct_sender direct_sender_;
+
+    //每个目标当前的发送路径；由 Redis 应答回调共同持有
+    struct DirectRoute
+    {
+        bool direct = false;        //当前经直连链路发送
+        size_t redisInflight = 0;   //已交给 Redis、尚未收到应答的帧
+        size_t directInflight = 0;  //已交给直连链路、尚未处理的帧
+        std::chrono::steady_clock::time_point redisIdleSince; //最后一帧 Redis 应答的时间
+    };
+    struct DirectRoutes
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, DirectRoute> routes;
+    };
+    std::shared_ptr<DirectRoutes> direct_routes_;
+
+    std::vector<std::string> subscribe_channels_;
+    std::thread subscribe_thread_;
+
+    //合并发布：通道 -> 已打包的消息帧，只在 Redis 线程中取走并发送，保证同一通道的消息顺序
+    bool batching_;
+    size_t max_batch_bytes_;
+    std::mutex batch_mutex_;
+    std::unordered_map<std::string, std::string> pending_batches_;
+    std::atomic<bool> flush_queued_; //已有提前刷新的任务在 Redis 线程排队
+    muduo::net::TimerId flush_timer_;
+
+    //Streams 传输
+    Transport transport_;
+    std::string stream_inbox_;
+    std::string stream_key_;
+    std::unordered_set<std::string> broadcast_channels_;
+    std::atomic<bool> stream_stop_;
+    std::thread stream_thread_;
+    //已读取、尚未确认的流消息ID：投递中或 XACK 应答未到；由确认回调共同持有
+    struct StreamInflight
+    {
+        std::mutex mutex;
+        std::unordered_set<std::string> ids;
+    };
+    std::shared_ptr<StreamInflight> stream_inflight_;
+
+    //以 Streams 接收的服务器，定时从 Redis 刷新；发送可能在任意线程，读写加锁
+    //由应答回调共同持有，析构后仍在途的 SMEMBERS 应答不会写到已释放的对象上
+    struct StreamServers
+    {
+        std::mutex mutex;
+        std::unordered_set<std::string> servers;
+    };
+    std::shared_ptr<StreamServers> stream_servers_;
+    muduo::net::TimerId stream_servers_timer_;
 };
 
 #endif
\ No newline at end of file
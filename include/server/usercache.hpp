@@ -0,0 +1,89 @@
+#ifndef USERCACHE_H
+#define USERCACHE_H
+
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "user.hpp"
+
+// 用户资料缓存：用户ID -> User，放在 UserModel::query 前面做读穿透
+// 部署或网络抖动后的登录风暴中，同一批热点账号的登录不再反复查询MySQL。
+//   1. 按用户ID分片加锁，每个分片是容量有上限的LRU
+//   2. 不存在的用户ID也缓存（负缓存），存活时间较短；注册新用户后显式失效，并通过在线状态通道通知其他服务器。
+//      大于已知最大用户ID的ID不做负缓存：其他服务器刚注册、通知尚未到达的用户不会被当作不存在
+//   3. 修改用户资料的路径必须调用 invalidate；条目另有存活时间，兜底其他服务器上的修改
+class UserCache
+{
+public:
+    UserCache(size_t capacity = 100000,
+              std::chrono::milliseconds ttl = std::chrono::minutes(10),
+              std::chrono::milliseconds negativeTtl = std::chrono::seconds(30));
+
+    // 命中返回 true：用户存在时 user 为缓存的资料，负缓存命中时 user 的 id 为 -1
+    bool get(long long userId, User &user);
+
+    // 查询数据库之前取得用户的失效版本，查询结果交给 put 时带上
+    uint64_t version(long long userId);
+
+    // 记录查询结果，user 的 id 为 -1 表示该用户不存在；
+    // version 之后该用户的条目被失效过时不写入，避免查询期间完成的注册被查询前的"不存在"覆盖
+    void put(long long userId, const User &user, uint64_t version);
+
+    // 失效用户的条目
+    void invalidate(long long userId);
+
+    uint64_t hits() const { return _hits.load(std::memory_order_relaxed); }
+    uint64_t negativeHits() const { return _negativeHits.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return _misses.load(std::memory_order_relaxed); }
+
+private:
+    static const size_t kShardCount = 16; // 必须是2的幂
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        long long userId;
+        User user;
+        Clock::time_point expireAt;
+    };
+
+    // 每个分片内按用户ID再分成若干失效版本槽，invalidate 递增所在槽的版本
+    static const size_t kVersionSlots = 256; // 必须是2的幂
+
+    // 链表头部是最近使用的条目，满时从尾部淘汰
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<long long, std::list<Entry>::iterator> index;
+        uint64_t versions[kVersionSlots] = {};
+    };
+
+    static size_t shardIndex(long long userId)
+    {
+        uint64_t h = static_cast<uint64_t>(userId) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(h >> 32) & (kShardCount - 1);
+    }
+
+    static size_t versionSlot(long long userId)
+    {
+        uint64_t h = static_cast<uint64_t>(userId) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(h >> 40) & (kVersionSlots - 1);
+    }
+
+    size_t _shardCapacity;
+    Clock::duration _ttl;
+    Clock::duration _negativeTtl;
+    Shard _shards[kShardCount];
+    std::atomic<long long> _maxKnownId; // 查询到的最大用户ID
+
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _negativeHits;
+    std::atomic<uint64_t> _misses;
+};
+
+#endif // USERCACHE_H
@@ -0,0 +1,95 @@
+#ifndef USERCONNREGISTRY_H
+#define USERCONNREGISTRY_H
+
+#include <muduo/net/TcpConnection.h>
+#include <unordered_map>
+#include <shared_mutex>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// 本服务器在线用户的连接表
+// 按用户ID分成多个分片，每个分片一把读写锁：
+//   - 登录/注销只锁住一个分片
+//   - 查找走读锁，群聊扇出等批量查找每个分片只加一次锁
+class UserConnRegistry
+{
+public:
+    // 记录用户连接，已存在时覆盖
+    void insert(long long userId, const TcpConnectionPtr &conn);
+
+    // 删除用户连接
+    void erase(long long userId);
+
+    // 查找用户连接，不在本服务器时返回空指针
+    TcpConnectionPtr find(long long userId) const;
+
+    // 批量查找：本地在线的连接放入found，不在本服务器的用户ID放入missing（可为空）
+    template <class Container>
+    void findBatch(const Container &userIds,
+                   std::vector<TcpConnectionPtr> &found,
+                   std::vector<long long> *missing = nullptr) const;
+
+    // 遍历所有在线连接，遍历期间逐个持有分片的读锁，回调中不要再访问本对象
+    void forEach(const std::function<void(long long, const TcpConnectionPtr &)> &fn) const;
+
+    // 在线连接总数
+    size_t size() const;
+
+private:
+    static const size_t kShardCount = 32; // 必须是2的幂
+
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<long long, TcpConnectionPtr> conns;
+    };
+
+    static size_t shardIndex(long long userId)
+    {
+        uint64_t h = static_cast<uint64_t>(userId) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(h >> 32) & (kShardCount - 1);
+    }
+
+    Shard _shards[kShardCount];
+};
+
+template <class Container>
+void UserConnRegistry::findBatch(const Container &userIds,
+                                 std::vector<TcpConnectionPtr> &found,
+                                 std::vector<long long> *missing) const
+{
+    // 先按分片归类，再逐个分片加一次读锁完成查找
+    std::vector<long long> idsByShard[kShardCount];
+    for (long long userId : userIds)
+    {
+        idsByShard[shardIndex(userId)].push_back(userId);
+    }
+
+    for (size_t i = 0; i < kShardCount; ++i)
+    {
+        if (idsByShard[i].empty())
+        {
+            continue;
+        }
+        const Shard &shard = _shards[i];
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (long long userId : idsByShard[i])
+        {
+            auto it = shard.conns.find(userId);
+            if (it != shard.conns.end())
+            {
+                found.push_back(it->second);
+            }
+            else if (missing != nullptr)
+            {
+                missing->push_back(userId);
+            }
+        }
+    }
+}
+
+#endif // USERCONNREGISTRY_H
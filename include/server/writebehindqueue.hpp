@@ -0,0 +1,123 @@
+#ifndef WRITEBEHINDQUEUE_H
+#define WRITEBEHINDQUEUE_H
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include "offlinemessagemodel.hpp"
+#include "friendmodel.hpp"
+#include "group_model.hpp"
+
+// 写回队列：离线消息、好友关系和群成员关系的写入只进入内存队列即返回，
+// 由后台线程按批合并成多行INSERT写入MySQL，突发的离线消息不再一条消息对应一次数据库事务。
+//   1. 队列按字节数限制内存，满时 append 返回 false，调用方退回同步写入
+//   2. 可选本地日志：入队时追加到日志文件，进程崩溃后下次启动重放；
+//      每批写库前 fdatasync，掉电时最多丢失一个刷新周期的写入。
+//      队列清空时截断日志；持续有写入、队列一直不空时，日志超过阈值后改写为只包含未落库的写入
+//   3. 连接断开、连接池取不到连接等暂时性错误：整个队列保留，退避后重试，不计入重试次数；
+//      服务器拒绝数据本身（见 PreparedStatement::rejected）：同批的写入改为逐条写库找出被拒绝的那条，
+//      单独写库被拒绝 kMaxRejections 次的写入移到死信日志（日志路径加 ".dead"，
+//      记录格式与日志相同，可改名为日志文件后重放）；未启用日志时记录到错误日志后丢弃
+//   4. stop() 把队列中的写入全部落库后才返回；MySQL 不可用时保留日志等待下次启动重放
+// 日志中可能留有已落库的写入（截断或改写之前崩溃），重放时会重复写入：
+// 好友和群成员关系用 insert ignore 去重，离线消息可能重复
+class WriteBehindQueue
+{
+public:
+    WriteBehindQueue(size_t maxPendingBytes = 64 * 1024 * 1024,
+                     std::chrono::milliseconds flushInterval = std::chrono::milliseconds(10),
+                     size_t maxBatchOps = 1024);
+    ~WriteBehindQueue();
+
+    WriteBehindQueue(const WriteBehindQueue&) = delete;
+    WriteBehindQueue& operator=(const WriteBehindQueue&) = delete;
+
+    // 启动刷新线程；journalPath 非空时启用本地日志，并先重放其中未落库的写入
+    bool start(const std::string &journalPath = "", bool fsyncJournal = true);
+
+    // 以下写入可在任意线程调用，队列已满或未启动时返回 false
+    bool appendOfflineMsg(long long userId, const std::string &msg);
+    // 同一条消息写给多个用户，队列中共享一份消息内容
+    bool appendOfflineMsgs(const std::vector<long long> &userIds, const std::string &msg);
+    bool appendFriend(long long userId, long long friendId);
+    bool appendGroupMember(long long userId, int groupId, const std::string &role);
+
+    // 等待调用前入队的写入全部落库，超时返回 false
+    // 读取这些表之前调用，保证读到自己刚写入的数据
+    bool sync(std::chrono::milliseconds timeout);
+
+    // 刷出所有写入并停止刷新线程
+    void stop();
+
+private:
+    enum OpType : uint8_t
+    {
+        OFFLINE_MSG = 1,  // a = 用户ID, text = 消息
+        FRIEND = 2,       // a = 用户ID, b = 好友ID
+        GROUP_MEMBER = 3  // a = 用户ID, b = 群组ID, text = 角色
+    };
+
+    struct WriteOp
+    {
+        OpType type;
+        long long a;
+        long long b;
+        std::shared_ptr<const std::string> text;
+        uint64_t seq; // 入队序号，用于 sync
+        uint32_t rejections; // 单独写库时被服务器拒绝的次数
+        bool isolated;       // 曾随一批写入被拒绝，之后单独写库
+    };
+
+    // 调用方持有 _mutex
+    bool appendLocked(OpType type, long long a, long long b, const std::shared_ptr<const std::string> &text);
+    void writeJournalLocked(const WriteOp &op);
+    bool replayJournal();
+    // 用队列中未落库的写入重写日志，调用方持有 _mutex 且没有正在写库的批次
+    void compactJournalLocked();
+    // 重试次数用尽的写入移到死信日志
+    void deadLetter(const WriteOp &op);
+
+    static void encodeRecord(const WriteOp &op, std::string &record);
+    static bool writeAll(int fd, const std::string &data);
+
+    void flushLoop();
+    // 把一批写入落库，失败的写入按原顺序放入 failed，返回是否全部成功
+    // 被服务器拒绝的写入在 failed 中已更新 rejections/isolated
+    bool writeBatch(const std::vector<WriteOp> &batch, std::vector<WriteOp> &failed);
+
+    static size_t opBytes(const WriteOp &op);
+
+    size_t _maxPendingBytes;
+    std::chrono::milliseconds _flushInterval;
+    size_t _maxBatchOps;
+
+    std::mutex _mutex;
+    std::condition_variable _flushCond;   // 唤醒刷新线程
+    std::condition_variable _flushedCond; // 一批写入完成，唤醒 sync
+    std::deque<WriteOp> _pending;
+    size_t _pendingBytes;
+    uint64_t _nextSeq;
+    uint64_t _inflightMinSeq; // 正在写库的批次中最小的序号，没有时为 UINT64_MAX
+    bool _flushNow;
+    bool _running;
+    bool _stopping;
+
+    std::string _journalPath;
+    int _journalFd;
+    size_t _journalBytes; // 日志文件当前大小
+    bool _fsyncJournal;
+    int _deadLetterFd;    // 首次使用时打开
+    std::thread _thread;
+
+    OfflineMsgModel _offlineMsgModel;
+    FriendModel _friendModel;
+    GroupModel _groupModel;
+};
+
+#endif // WRITEBEHINDQUEUE_H
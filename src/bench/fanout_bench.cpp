@@ -0,0 +1,146 @@
+// 群聊扇出基准：统计一条群消息发给 N 个本地成员时的内存分配次数和耗时
+//   per-recipient : 旧实现，每个成员的发送任务各自拷贝JSON和二进制文本，发送时再拷贝进临时 Buffer
+//   shared+buffer : 共享 ChatPayload，但发送时仍为每个成员拷贝进临时 Buffer
+//   shared frame  : 共享 ChatPayload 中封装好的帧，发送直接从共享内存写套接字
+// 套接字写入用写 /dev/null 代替，对应 muduo 输出缓冲区为空时直接 write 的路径
+//
+// 用法：./FanOutBench [每种规模的扇出次数]
+#include "chatpayload.hpp"
+#include <muduo/net/Buffer.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+// 统计全局 operator new 的调用次数
+static std::atomic<size_t> g_allocs(0);
+
+void* operator new(size_t size)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+static int g_sink = -1;
+
+static void writeSocket(const char* data, size_t len)
+{
+    if (::write(g_sink, data, len) < 0) {
+        perror("write");
+        exit(1);
+    }
+}
+
+// 旧 ChatCodec::send：把消息拷贝进临时 Buffer，补帧头后发送
+static void sendByBuffer(const std::string& message)
+{
+    muduo::net::Buffer buf;
+    buf.append(message.data(), message.size());
+    buf.prependInt32(static_cast<int32_t>(message.size()));
+    writeSocket(buf.peek(), buf.readableBytes());
+}
+
+// 一次扇出：先像 fanOut 一样为每个 EventLoop 准备一个发送任务，再执行这些任务
+static void perRecipient(const json& js, size_t members)
+{
+    std::string jsonText = js.dump();
+    binaryproto::ChatMessage message;
+    binaryproto::fromJson(js, message);
+    std::string binaryText = binaryproto::encode(message);
+
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < members; ++i) {
+        tasks.emplace_back([jsonText, binaryText, i]() {
+            sendByBuffer(i % 2 ? binaryText : jsonText);
+        });
+    }
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+static void sharedBuffer(const ChatCodec& codec, const json& js, size_t members)
+{
+    ChatPayloadPtr payload = makeChatPayload(codec, js);
+    std::function<void()> task = [payload, members]() {
+        for (size_t i = 0; i < members; ++i) {
+            sendByBuffer(i % 2 ? payload->binary : payload->json);
+        }
+    };
+    task();
+}
+
+static void sharedFrame(const ChatCodec& codec, const json& js, size_t members)
+{
+    ChatPayloadPtr payload = makeChatPayload(codec, js);
+    std::function<void()> task = [payload, members]() {
+        for (size_t i = 0; i < members; ++i) {
+            const std::string& frame = i % 2 ? payload->binaryFrame : payload->jsonFrame;
+            writeSocket(frame.data(), frame.size());
+        }
+    };
+    task();
+}
+
+template<class Fanout>
+static void measure(const char* name, size_t members, size_t rounds, Fanout fanout)
+{
+    size_t allocsBefore = g_allocs.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        fanout(members);
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    double allocs = static_cast<double>(g_allocs.load() - allocsBefore) / rounds;
+    printf("%8zu %-15s %14.1f %14.1f\n", members, name, allocs, us / rounds);
+}
+
+int main(int argc, char** argv)
+{
+    size_t rounds = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000;
+    g_sink = ::open("/dev/null", O_WRONLY);
+    if (g_sink < 0) {
+        perror("open /dev/null");
+        return 1;
+    }
+
+    ChatCodec codec(ChatCodec::LENGTH_HEADER);
+    json js;
+    js["msgid"] = GROUP_CHAT_MSG;
+    js["id"] = 13;
+    js["name"] = "zhang san";
+    js["groupid"] = 1001;
+    js["msg"] = std::string(200, 'x');
+    js["time"] = "2024-01-01 12:00:00";
+
+    printf("%zu fan-outs per row, half of the members use the binary wire\n", rounds);
+    printf("%8s %-15s %14s %14s\n", "members", "path", "allocs/fanout", "us/fanout");
+    for (size_t members : {10, 100, 1000, 2000}) {
+        measure("per-recipient", members, rounds, [&](size_t n) { perRecipient(js, n); });
+        measure("shared+buffer", members, rounds, [&](size_t n) { sharedBuffer(codec, js, n); });
+        measure("shared frame", members, rounds, [&](size_t n) { sharedFrame(codec, js, n); });
+    }
+    ::close(g_sink);
+    return 0;
+}
@@ -0,0 +1,119 @@
+// ThreadPool 基准：对比基于互斥锁的旧任务队列和无锁 MPMC 队列
+// 在不同的生产者/消费者数量下，统计提交并执行完固定数量任务的吞吐量
+//
+// 用法：./ThreadPoolBench [每轮任务数]
+#include "ThreadPool.hpp"
+#include <queue>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// 旧实现：std::queue + 互斥锁 + 条件变量，每次提交都加锁并唤醒一个工作线程
+class MutexThreadPool {
+public:
+    MutexThreadPool(size_t threadCount, size_t queueCapacity)
+        : queueCapacity_(queueCapacity), stop_(false) {
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers_.emplace_back([this] {
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(queueMutex_);
+                        condition_.wait(lock, [this] { return stop_.load() || !tasks_.empty(); });
+                        if (stop_.load() && tasks_.empty()) {
+                            return;
+                        }
+                        task = std::move(tasks_.front());
+                        tasks_.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~MutexThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            stop_.store(true);
+        }
+        condition_.notify_all();
+        for (std::thread &worker : workers_) {
+            worker.join();
+        }
+    }
+
+    template<class F>
+    bool enqueue(F&& task) {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            if (stop_.load() || tasks_.size() >= queueCapacity_) {
+                return false;
+            }
+            tasks_.emplace(std::forward<F>(task));
+        }
+        condition_.notify_one();
+        return true;
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    const size_t queueCapacity_;
+    std::mutex queueMutex_;
+    std::condition_variable condition_;
+    std::atomic<bool> stop_;
+};
+
+// 与 ChatService 中单个执行器分片的容量同一数量级
+static const size_t kQueueCapacity = 4096;
+
+// producers 个线程共提交 tasks 个任务，队列满时让出CPU后重试；返回每秒完成的任务数
+template<class Pool>
+static double run(size_t producers, size_t consumers, size_t tasks)
+{
+    std::atomic<size_t> done(0);
+    auto start = std::chrono::steady_clock::now();
+    {
+        Pool pool(consumers, kQueueCapacity);
+        std::vector<std::thread> threads;
+        for (size_t p = 0; p < producers; ++p) {
+            size_t count = tasks / producers + (p < tasks % producers ? 1 : 0);
+            threads.emplace_back([&pool, &done, count] {
+                for (size_t i = 0; i < count; ++i) {
+                    while (!pool.enqueue([&done] { done.fetch_add(1, std::memory_order_relaxed); })) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (std::thread &t : threads) {
+            t.join();
+        }
+        // 析构时等待剩余任务执行完
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (done.load() != tasks) {
+        fprintf(stderr, "lost tasks: %zu of %zu executed\n", done.load(), tasks);
+        exit(1);
+    }
+    return tasks / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    size_t tasks = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    const size_t counts[] = {1, 2, 4, 8};
+
+    printf("%zu tasks per run, queue capacity %zu\n", tasks, kQueueCapacity);
+    printf("%9s %9s %14s %14s %8s\n", "producers", "consumers", "mutex ops/s", "mpmc ops/s", "speedup");
+    for (size_t producers : counts) {
+        for (size_t consumers : counts) {
+            double mutexRate = run<MutexThreadPool>(producers, consumers, tasks);
+            double mpmcRate = run<ThreadPool>(producers, consumers, tasks);
+            printf("%9zu %9zu %14.0f %14.0f %7.2fx\n", producers, consumers, mutexRate, mpmcRate,
+                   mpmcRate / mutexRate);
+        }
+    }
+    return 0;
+}
@@ -11,6 +11,8 @@
 #include <mutex>
 #include <condition_variable>
 #include <limits> // for numeric_limits
+#include <cstring>
+#include <cstdint>
 
 #include <unistd.h>
 #include <sys/socket.h>
@@ -20,6 +22,7 @@
 #include "group.hpp"
 #include "user.hpp"
 #include "public.hpp"
+#include "binaryproto.hpp"
 
 using json = nlohmann::json;
 
@@ -46,6 +49,12 @@ using json = nlohmann::json;
 // ChatClient 客户端类
 class ChatClient {
 public:
+    // 帧格式需与服务器一致：默认4字节长度头，line 为换行分隔的JSON
+    void setLineDelimited(bool lineDelimited) { _lineDelimited = lineDelimited; }
+
+    // 是否在登录时请求二进制编码收发聊天消息，仅长度头分帧下生效
+    void setBinaryWire(bool binaryWire) { _binaryWire = binaryWire; }
+
     // 连接服务器
     bool connect(const char* ip, uint16_t port) {
         _clientfd = socket(AF_INET, SOCK_STREAM, 0);
@@ -118,6 +127,9 @@ private:
             js["msgid"] = LOGIN_MSG;
             js["id"] = id;
             js["password"] = pwd;
+            if (_binaryWire && !_lineDelimited) {
+                js["wire"] = "binary";
+            }
             
             // 等待网络响应
             {
@@ -204,6 +216,7 @@ private:
         } else {
             _currentUser.setId(responsejs["id"].get<long long>());
             _currentUser.setName(responsejs["name"]);
+            _binaryNegotiated = responsejs.contains("wire") && responsejs["wire"] == "binary";
 
             if (responsejs.contains("friends")) {
                 _currentUserFriendList.clear();
@@ -240,63 +253,114 @@ private:
 
             showCurrentUserData();
 
-            if (responsejs.contains("offlinemsg")) {
-                // 现在 offlinemsg 直接就是一个JSON对象数组，可以直接遍历和使用
-                for (auto &js : responsejs["offlinemsg"]) {
-                    printMessage(js); // 无需二次解析
-                }
-            }
+            // 离线消息在登录应答之后以 OFFLINE_MSG_PAGE 逐页到达
             _isLoggedIn = true; // 标记为登录成功
         }
     }
 
+    // 显示一页离线消息并确认，服务器收到确认后删除这些消息并下发下一页
+    void doOfflinePage(json &pagejs) {
+        for (auto &js : pagejs["msgs"]) {
+            if (js.is_object()) {
+                printMessage(js); // 无需二次解析
+            }
+        }
+        json ack;
+        ack["msgid"] = OFFLINE_MSG_PAGE_ACK;
+        ack["id"] = _currentUser.getId();
+        ack["lastid"] = pagejs["lastid"];
+        sendFrame(ack.dump());
+    }
+
     // === 接收和心跳线程 ===
     void readTaskHandler() {
+        std::string recvBuf;
         while (true) {
-            char buffer[4096] = {0};
+            char buffer[4096];
             int len = recv(_clientfd, buffer, sizeof(buffer), 0);
             if (len <= 0) {
                 std::cerr << "Server disconnected." << std::endl;
                 close(_clientfd);
                 exit(0);
             }
+            recvBuf.append(buffer, len);
 
-            try {
-                json js = json::parse(buffer);
-                int msgtype = js["msgid"].get<int>();
-
-                if (ONE_CHAT_MSG == msgtype || GROUP_CHAT_MSG == msgtype) {
-                    printMessage(js);
-                } else if (LOGIN_MSG_ACK == msgtype) {
-                    doLoginResponse(js);
-                    _responseCv.notify_one(); // 通知主线程
-                } else if (REGISTER_MSG_ACK == msgtype) {
-                    doRegResponse(js);
-                    _responseCv.notify_one(); // 通知主线程
-                } else if (CREATE_GROUP_MSG_ACK == msgtype) {
-                    if (js["errno"].get<int>() == 0) {
-                        std::cout << "\nGroup created successfully! Group ID: " << js["groupid"].get<int>() << std::endl;
-                    } else {
-                        std::cout << "\nFailed to create group." << std::endl;
-                    }
-                }else if (ADD_GROUP_MSG_ACK == msgtype) {
-                    if (js["errno"].get<int>() == 0) {
-                        std::cout << "\nSuccessfully joined group: " << js["groupid"].get<int>() << std::endl;
-                    } else {
-                        std::cout << "\nFailed to join group." << std::endl;
-                    }
-                }else if (ADD_FRIEND_MSG_ACK == msgtype) {
-                    if (js["errno"].get<int>() == 0) {
-                        std::cout << "\nFriend request sent/accepted for user: " << js["friendid"].get<long long>() << std::endl;
-                    } else {
-                        std::cout << "\nFailed to add friend." << std::endl;
-                    }
-                }
-        
-            } catch (const json::parse_error& e) {
-                 // 不打印错误，因为TCP粘包可能导致解析失败，这是预期的
-                 // 更好的解决方案是实现一个完整的应用层协议（如长度+内容）
+            // 取出所有完整的帧，不完整的帧留在recvBuf中等待后续数据
+            std::string frame;
+            while (retrieveFrame(recvBuf, frame)) {
+                handleMessage(frame);
+            }
+        }
+    }
+
+    // 从接收缓冲区取出一个完整的帧
+    bool retrieveFrame(std::string& recvBuf, std::string& frame) {
+        if (_lineDelimited) {
+            size_t eol = recvBuf.find('\n');
+            if (eol == std::string::npos) return false;
+            frame = recvBuf.substr(0, eol);
+            recvBuf.erase(0, eol + 1);
+            return true;
+        }
+
+        if (recvBuf.size() < kHeaderLen) return false;
+        uint32_t be32 = 0;
+        memcpy(&be32, recvBuf.data(), kHeaderLen);
+        size_t len = ntohl(be32);
+        if (recvBuf.size() < kHeaderLen + len) return false;
+        frame = recvBuf.substr(kHeaderLen, len);
+        recvBuf.erase(0, kHeaderLen + len);
+        return true;
+    }
+
+    void handleMessage(const std::string& frame) {
+        if (binaryproto::isBinary(frame)) {
+            binaryproto::ChatMessage message;
+            if (binaryproto::decode(frame, message)) {
+                printMessage(binaryproto::toJson(message));
+            } else {
+                std::cerr << "invalid binary message from server" << std::endl;
+            }
+            return;
+        }
+
+        json js = json::parse(frame, nullptr, false);
+        if (js.is_discarded() || !js.contains("msgid")) {
+            std::cerr << "invalid message from server: " << frame << std::endl;
+            return;
+        }
+        int msgtype = js["msgid"].get<int>();
+
+        if (ONE_CHAT_MSG == msgtype || GROUP_CHAT_MSG == msgtype) {
+            printMessage(js);
+        } else if (OFFLINE_MSG_PAGE == msgtype) {
+            doOfflinePage(js);
+        } else if (LOGIN_MSG_ACK == msgtype) {
+            doLoginResponse(js);
+            _responseCv.notify_one(); // 通知主线程
+        } else if (REGISTER_MSG_ACK == msgtype) {
+            doRegResponse(js);
+            _responseCv.notify_one(); // 通知主线程
+        } else if (CREATE_GROUP_MSG_ACK == msgtype) {
+            if (js["errno"].get<int>() == 0) {
+                std::cout << "\nGroup created successfully! Group ID: " << js["groupid"].get<int>() << std::endl;
+            } else {
+                std::cout << "\nFailed to create group." << std::endl;
+            }
+        } else if (ADD_GROUP_MSG_ACK == msgtype) {
+            if (js["errno"].get<int>() == 0) {
+                std::cout << "\nSuccessfully joined group: " << js["groupid"].get<int>() << std::endl;
+            } else {
+                std::cout << "\nFailed to join group." << std::endl;
             }
+        } else if (ADD_FRIEND_MSG_ACK == msgtype) {
+            if (js["errno"].get<int>() == 0) {
+                std::cout << "\nFriend request sent/accepted for user: " << js["friendid"].get<long long>() << std::endl;
+            } else {
+                std::cout << "\nFailed to add friend." << std::endl;
+            }
+        } else if (-1 == msgtype) {
+            std::cerr << "\n" << js["errmsg"].get<std::string>() << std::endl;
         }
     }
 
@@ -314,7 +378,24 @@ private:
 
     // === 辅助函数 ===
     void sendJson(const json& js) {
-        std::string request = js.dump();
+        // 协商了二进制编码后，聊天消息改用二进制帧发送
+        if (_binaryNegotiated) {
+            binaryproto::ChatMessage message;
+            if (binaryproto::fromJson(js, message)) {
+                sendFrame(binaryproto::encode(message));
+                return;
+            }
+        }
+        sendFrame(js.dump());
+    }
+
+    void sendFrame(std::string request) {
+        if (_lineDelimited) {
+            request.push_back('\n');
+        } else {
+            uint32_t be32 = htonl(static_cast<uint32_t>(request.size()));
+            request.insert(0, reinterpret_cast<const char*>(&be32), kHeaderLen);
+        }
         if (send(_clientfd, request.c_str(), request.length(), 0) == -1) {
             std::cerr << "send msg error:" << request << std::endl;
         }
@@ -456,13 +537,19 @@ private:
         js["id"] = _currentUser.getId();
         sendJson(js);
         _isLoggedIn = false; // 标记为登出
+        _binaryNegotiated = false;
         _currentUserFriendList.clear();
         _currentUserGroupList.clear();
     }
     
 private:
+    static constexpr size_t kHeaderLen = sizeof(uint32_t);
+
     // 数据成员
     int _clientfd = -1;
+    bool _lineDelimited = false;
+    bool _binaryWire = true;
+    std::atomic_bool _binaryNegotiated{false};
     std::atomic_bool _isLoggedIn{false};
     User _currentUser;
     std::vector<User> _currentUserFriendList;
@@ -497,11 +584,19 @@ int main(int argc, char **argv)
 {
     if (argc < 3)
     {
-        std::cerr << "command invalid! example: ./ChatClient 127.0.0.1 6000" << std::endl;
+        std::cerr << "command invalid! example: ./ChatClient 127.0.0.1 6000 [length|line] [binary|json]" << std::endl;
         exit(-1);
     }
 
     ChatClient client;
+    for (int i = 3; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "line") {
+            client.setLineDelimited(true);
+        } else if (option == "json") {
+            client.setBinaryWire(false);
+        }
+    }
     if (client.connect(argv[1], atoi(argv[2]))) {
         client.run();
     } else {
@@ -0,0 +1,97 @@
+#include "chatcodec.hpp"
+#include <muduo/base/Logging.h>
+#include <arpa/inet.h>
+
+ChatCodec::DecodeResult ChatCodec::retrieveFrame(Buffer *buffer, std::string &frame) const
+{
+    if (_mode == LENGTH_HEADER)
+    {
+        if (buffer->readableBytes() < kHeaderLen)
+        {
+            return FRAME_INCOMPLETE;
+        }
+
+        // 只窥视长度头，不足一帧时数据原样留在buffer中
+        const int32_t len = buffer->peekInt32();
+        if (len < 0 || len > kMaxFrameLen)
+        {
+            LOG_ERROR << "invalid frame length " << len;
+            return FRAME_INVALID;
+        }
+        if (buffer->readableBytes() < kHeaderLen + len)
+        {
+            return FRAME_INCOMPLETE;
+        }
+
+        buffer->retrieve(kHeaderLen);
+        frame.assign(buffer->peek(), len);
+        buffer->retrieve(len);
+        return FRAME_OK;
+    }
+
+    // LINE_DELIMITED：跳过空行，直到找到一条以'\n'结尾的JSON文本
+    for (;;)
+    {
+        const char *eol = buffer->findEOL();
+        if (eol == nullptr)
+        {
+            if (buffer->readableBytes() > static_cast<size_t>(kMaxFrameLen))
+            {
+                LOG_ERROR << "line frame exceeds " << kMaxFrameLen << " bytes";
+                return FRAME_INVALID;
+            }
+            return FRAME_INCOMPLETE;
+        }
+
+        const char *end = eol;
+        if (end > buffer->peek() && *(end - 1) == '\r')
+        {
+            --end;
+        }
+        frame.assign(buffer->peek(), end);
+        buffer->retrieveUntil(eol + 1);
+        if (!frame.empty())
+        {
+            return FRAME_OK;
+        }
+    }
+}
+
+std::string ChatCodec::encode(const std::string &message) const
+{
+    std::string frame;
+    if (_mode == LENGTH_HEADER)
+    {
+        frame.reserve(kHeaderLen + message.size());
+        uint32_t len = htonl(static_cast<uint32_t>(message.size()));
+        frame.append(reinterpret_cast<const char *>(&len), kHeaderLen);
+        frame.append(message);
+    }
+    else
+    {
+        frame.reserve(message.size() + 1);
+        frame.append(message);
+        frame.push_back('\n');
+    }
+    return frame;
+}
+
+void ChatCodec::send(const TcpConnectionPtr &conn, const std::string &message) const
+{
+    Buffer buf;
+    buf.append(message.data(), message.size());
+    send(conn, &buf);
+}
+
+void ChatCodec::send(const TcpConnectionPtr &conn, Buffer *body) const
+{
+    if (_mode == LENGTH_HEADER)
+    {
+        body->prependInt32(static_cast<int32_t>(body->readableBytes()));
+    }
+    else
+    {
+        body->append("\n", 1);
+    }
+    conn->send(body);
+}
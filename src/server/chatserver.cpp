@@ -1,9 +1,11 @@
 #include "chatserver.hpp"
 #include "json.hpp"
 #include "chatservice.hpp"
+#include "binaryproto.hpp"
 #include <iostream>
 #include <functional>
 #include <string>
+#include <any>
 #include <muduo/base/Logging.h>
 using namespace std;
 using namespace placeholders;
@@ -35,8 +37,13 @@ void ChatServer::start()
 // 连接事件相关信息的回调函数
 void ChatServer::onConnection(const TcpConnectionPtr &conn)
 {
+    // 新连接：在 I/O 线程中绑定会话，之后只修改会话内容，不再替换 context
+    if (conn->connected())
+    {
+        conn->setContext(std::make_shared<ChatSession>());
+    }
     // 客户端断开连接
-    if (!conn->connected())
+    else
     {
         // 处理客户端异常退出事件
         ChatService::instance()->clientCloseExceptionHandler(conn);
@@ -69,45 +76,57 @@ void ChatServer::onMessage(const TcpConnectionPtr &conn,
                            Buffer *buffer,
                            Timestamp time)
 {
-    string buf = buffer->retrieveAllAsString();
-    json js = json::parse(buf.c_str());
-    
-    auto msgHandler = ChatService::instance()->getHandler(js["msgid"].get<int>());
+    ChatCodec *codec = ChatService::instance()->getCodec();
 
-    ThreadPool* pool = ChatService::instance()->getThreadPool();
-    
-    if (pool)
+    // 一次读回调中取出所有完整的帧，不完整的帧留在buffer中等待后续数据
+    string frame;
+    ChatCodec::DecodeResult result;
+    while ((result = codec->retrieveFrame(buffer, frame)) == ChatCodec::FRAME_OK)
     {
-        // ******************* 核心修改 *******************
-        // 使用 mutable 关键字，使得按值捕获的变量可以在 lambda 内部被修改
-        bool success = pool->enqueue([=]() {
-            // 这个lambda捕获了所有需要的上下文，并将在工作线程中执行
-            // 注意：这里没有使用 mutable，因为 js 和 conn 都是拷贝/智能指针拷贝，
-            // 在lambda内部不需要修改它们自身。
-            msgHandler(conn, js, time);
-        });
+        onFrame(conn, frame, time);
+    }
 
-        // 关键：处理任务提交失败的情况
-        if (!success)
+    if (result == ChatCodec::FRAME_INVALID)
+    {
+        LOG_ERROR << "invalid frame from " << conn->name() << ", shutdown connection";
+        conn->shutdown();
+    }
+}
+
+// 处理一个完整的消息帧
+void ChatServer::onFrame(const TcpConnectionPtr &conn,
+                         const string &frame,
+                         Timestamp time)
+{
+    json js;
+    if (binaryproto::isBinary(frame))
+    {
+        // 只接受登录时协商了二进制编码的连接发来的二进制帧
+        const ChatSession* session = getSession(conn);
+        if (session == nullptr || !session->binaryWire)
         {
-            // 线程池队列已满，服务器繁忙
-            LOG_WARN << "ThreadPool is full, task rejected for user on connection " << conn->name();
-            
-            // 向客户端发送服务不可用响应
-            json response;
-            response["msgid"] = -1; // 使用一个特殊的msgid表示错误
-            response["errno"] = 503; // 类似HTTP 503 Service Unavailable
-            response["errmsg"] = "Server is busy, please try again later.";
-            conn->send(response.dump());
-            
-            // 可以选择不关闭连接，让客户端稍后重试
-            // conn->shutdown(); 
+            LOG_ERROR << "binary frame on connection without binary wire: " << conn->name();
+            return;
         }
-        // ***********************************************
+        // 二进制聊天消息直接按字段还原，省去JSON文本解析
+        binaryproto::ChatMessage message;
+        if (!binaryproto::decode(frame, message))
+        {
+            LOG_ERROR << "bad binary frame from " << conn->name();
+            return;
+        }
+        js = binaryproto::toJson(message);
     }
     else
     {
-        // 线程池未初始化，记录错误
-        LOG_ERROR << "ThreadPool is not initialized!";
+        js = json::parse(frame, nullptr, false);
+        if (js.is_discarded() || !js.contains("msgid"))
+        {
+            LOG_ERROR << "bad message frame from " << conn->name() << ": " << frame;
+            return;
+        }
     }
+
+    // 提交到业务执行器：分片键和登录期间的暂存都由本 I/O 线程持有的会话决定
+    ChatService::instance()->dispatch(conn, js, time);
 }
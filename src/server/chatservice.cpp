@@ -1,9 +1,11 @@
 #include "chatservice.hpp"
 #include "public.hpp"
+#include "binaryproto.hpp"
 #include <muduo/base/Logging.h>
 #include <muduo/net/EventLoop.h>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <any>
 #include <thread>
 using namespace muduo;
@@ -12,6 +14,74 @@ using namespace std;
 // int getUserId(json& js) { return js["id"].get<int>(); }
 // std::string getUserName(json& js) { return js["name"]; }
 
+// 用户登录/下线事件的广播通道，所有服务器都订阅
+static const std::string kPresenceChannel = "presence_events";
+
+// 登录时等待写回队列落库的最长时间
+static const std::chrono::milliseconds kWriteBehindSyncTimeout(500);
+
+// 离线消息每页的最大条数和大致字节数上限，登录应答和每一页的大小都与积压量无关
+static const int kOfflinePageRows = 100;
+static const size_t kOfflinePageBytes = 64 * 1024;
+
+// 连接对应的业务执行器分片：已登录的连接按用户ID，未登录的按连接，与 ChatService::dispatch 一致
+static size_t shardKey(const TcpConnectionPtr &conn)
+{
+    const ChatSession* session = getSession(conn);
+    long long userId = session != nullptr ? session->userId.load() : -1;
+    return userId != -1 ? static_cast<size_t>(userId) : reinterpret_cast<size_t>(conn.get());
+}
+
+// 登录处理期间每个连接最多暂存的消息数，超出的消息按服务器繁忙拒绝
+static const size_t kMaxDeferredFrames = 256;
+
+// 业务执行器已满时，Redis 线程中的完成回调重新提交的间隔（秒）
+static const double kRedisRetryDelay = 0.001;
+
+// 数据库执行器的线程数和队列容量：线程数不超过连接池上限，避免线程在取连接时排队
+static const size_t kDbThreads = 8;
+static const size_t kDbQueueCapacity = 65536;
+
+template<class Query, class Done>
+void ChatService::runDbAsync(size_t key, Query query, Done done)
+{
+    auto task = [this, key, query, done]() {
+        auto result = std::make_shared<decltype(query())>(query());
+        auto completion = [done, result]() { done(*result); };
+        // 业务执行器已满时直接在数据库线程中完成，宁可占用数据库线程也不丢弃应答
+        if (!_executor->enqueue(key, completion)) {
+            completion();
+        }
+    };
+    // 数据库执行器已满时退回在当前线程同步执行
+    if (!_dbExecutor->enqueue(key, task)) {
+        task();
+    }
+}
+
+void ChatService::postFromRedis(size_t key, std::function<void()> task)
+{
+    // 分片已满时稍后在 Redis 线程中重新提交，任务本身绝不在 Redis 线程中执行：
+    // 它可能访问 MySQL，会拖住所有 Redis 应答和订阅消息
+    if (!_executor->enqueue(key, task)) {
+        // 停止服务时业务执行器已排空，不会再接受任务：直接在这里执行，不丢弃消息
+        if (_executor->stopped()) {
+            task();
+            return;
+        }
+        LOG_WARN << "executor shard is full, retry posting redis completion later";
+        _asyncRedis->getLoop()->runAfter(kRedisRetryDelay, [this, key, task]() { postFromRedis(key, task); });
+    }
+}
+
+template<class Write>
+void ChatService::postDbWrite(size_t key, Write write)
+{
+    if (!_dbExecutor->enqueue(key, write)) {
+        write();
+    }
+}
+
 ChatService::ChatService()
 {
     // 对各类消息处理方法的注册
@@ -25,19 +95,193 @@ ChatService::ChatService()
     _msgHandlerMap.insert({GROUP_CHAT_MSG, std::bind(&ChatService::groupChat, this, _1, _2, _3)});
     _msgHandlerMap.insert({HEARTBEAT_MSG, std::bind(&ChatService::heartbeatHandler, this, _1, _2, _3)});
     _msgHandlerMap.insert({LOGINOUT_MSG, std::bind(&ChatService::logoutHandler, this, _1, _2, _3)});
+    _msgHandlerMap.insert({OFFLINE_MSG_PAGE_ACK, std::bind(&ChatService::offlineMsgAckHandler, this, _1, _2, _3)});
+
+}
+
+ChatService::~ChatService()
+{
+    // 正常退出时 main 已调用过 shutdown；这里兜底，保证执行器和订阅线程先于成员析构停止
+    shutdown();
+}
+void ChatService::shutdown()
+{
+    if (_shutdown) {
+        return;
+    }
+    _shutdown = true;
+
+    // 1. 停止消息来源：订阅线程和流消费线程不再向投递执行器提交消息
+    _redis.stop();
+    // 直连网格的入站帧同样提交到投递执行器；_redis 析构时还会刷出剩余批次，
+    // 在 Redis 线程中摘掉直连发送并释放网格：网格析构时把尚未写出的帧按顺序交还 Redis，
+    // 期间 Redis 线程不再发送新的帧，不会越过这些帧
+    if (_mesh) {
+        _asyncRedis->runInLoopAndWait([this]() {
+            _redis.setDirectSender(direct_ready(), direct_sender(), {});
+            _mesh.reset();
+        });
+    }
+
+    // 2. 按 投递 -> 业务 -> 数据库 的顺序排空执行器：上游剩余任务提交的下游任务仍能执行，
+    //    此时数据库连接池仍然可用
+    if (_deliveryExecutor) {
+        _deliveryExecutor->stop();
+    }
+    if (_executor) {
+        _executor->stop();
+    }
+    if (_dbExecutor) {
+        _dbExecutor->stop();
+    }
 
+    // 3. 所有可能入队的任务都已执行完，最后把写回队列中尚未落库的写入全部刷出
+    if (_writeBehind) {
+        _writeBehind->stop();
+    }
+    LOG_INFO << "user cache hits: " << _userCache.hits() << ", negative hits: " << _userCache.negativeHits()
+             << ", misses: " << _userCache.misses();
 }
-ThreadPool* ChatService::getThreadPool()
+
+ShardedExecutor* ChatService::getExecutor()
 {
     // unique_ptr 的 get() 方法返回其管理的对象的裸指针
-    return _threadPool.get();
+    return _executor.get();
+}
+
+ChatCodec* ChatService::getCodec()
+{
+    return &_codec;
+}
+
+// 服务器繁忙：通知客户端稍后重试，不关闭连接
+static void sendBusy(ChatCodec &codec, const TcpConnectionPtr &conn)
+{
+    json response;
+    response["msgid"] = -1; // 使用一个特殊的msgid表示错误
+    response["errno"] = 503; // 类似HTTP 503 Service Unavailable
+    response["errmsg"] = "Server is busy, please try again later.";
+    codec.send(conn, response.dump());
+}
+
+void ChatService::dispatch(const TcpConnectionPtr &conn, json &js, Timestamp time)
+{
+    ChatSession* session = getSession(conn);
+    if (session == nullptr) {
+        return;
+    }
+    // 登录结果决定后续消息的分片和会话状态，登录完成前到达的消息先暂存
+    if (session->loginPending) {
+        if (session->deferred.size() >= kMaxDeferredFrames) {
+            LOG_WARN << "too many frames during login on connection " << conn->name();
+            sendBusy(_codec, conn);
+            return;
+        }
+        session->deferred.emplace_back(std::move(js), time);
+        return;
+    }
+
+    int msgid = js["msgid"].get<int>();
+    auto msgHandler = getHandler(msgid);
+
+    // 已登录的连接按用户ID分片，保证同一用户的消息按序处理；
+    // 未登录的连接（登录、注册请求）按连接分片。会话只在本 I/O 线程中写入，这里读到的就是最新值
+    size_t key = shardKey(conn);
+
+    // 使用 mutable 关键字，使得按值捕获的 js 可以以非const引用传给业务处理器
+    bool success = _executor->enqueue(key, [msgHandler, conn, js, time]() mutable {
+        msgHandler(conn, js, time);
+    });
+    if (!success) {
+        // 分片队列已满，服务器繁忙
+        LOG_WARN << "Executor shard is full, task rejected for user on connection " << conn->name();
+        sendBusy(_codec, conn);
+        return;
+    }
+    if (msgid == LOGIN_MSG) {
+        session->loginPending = true;
+    }
+}
+
+void ChatService::resumeSession(const TcpConnectionPtr &conn, long long userId, bool binaryWire)
+{
+    conn->getLoop()->runInLoop([this, conn, userId, binaryWire]() {
+        ChatSession* session = getSession(conn);
+        if (session == nullptr) {
+            return;
+        }
+        if (userId != -1) {
+            if (!conn->connected()) {
+                // 登录期间连接已断开，断开处理时会话尚未登录，这里释放刚占有的在线状态
+                _RedisStateStorage->setUserOfflineAsync(userId);
+                publishPresenceEvent("logout", userId);
+                return;
+            }
+            session->userId = userId;
+            session->binaryWire = binaryWire;
+            // 会话写入之后才登记连接，此后发往该连接的消息都按协商的编码发送
+            _userConns.insert(userId, conn);
+        }
+        session->loginPending = false;
+
+        // 按到达顺序重新提交暂存的消息；其中若再有登录请求，其后的消息会重新暂存
+        std::vector<std::pair<json, Timestamp>> deferred;
+        deferred.swap(session->deferred);
+        if (!conn->connected()) {
+            return;
+        }
+        for (auto &frame : deferred) {
+            dispatch(conn, frame.first, frame.second);
+        }
+    });
+}
+
+void ChatService::sendChatMessage(const TcpConnectionPtr &conn, const ChatPayload &payload)
+{
+    const ChatSession* session = getSession(conn);
+    // 直接发送负载中已封装好的帧，同一条消息的所有接收者共用这份内存
+    if (session != nullptr && session->binaryWire && !payload.binaryFrame.empty()) {
+        _codec.sendFrame(conn, payload.binaryFrame);
+    } else {
+        _codec.sendFrame(conn, payload.jsonFrame);
+    }
+}
+
+void ChatService::fanOut(vector<TcpConnectionPtr> &conns, const ChatPayloadPtr &payload)
+{
+    // 按 EventLoop 分桶，大群广播时每个 subLoop 只被唤醒一次
+    std::unordered_map<EventLoop*, vector<TcpConnectionPtr>> connsByLoop;
+    for (auto &conn : conns) {
+        connsByLoop[conn->getLoop()].push_back(std::move(conn));
+    }
+    conns.clear();
+
+    for (auto &bucket : connsByLoop) {
+        bucket.first->runInLoop([this, targets = std::move(bucket.second), payload]() {
+            for (const auto &targetConn : targets) {
+                sendChatMessage(targetConn, *payload);
+            }
+        });
+    }
 }
 
-void ChatService::init(const std::string& server_id) {
+void ChatService::init(const std::string& server_id, ChatCodec::FrameMode frame_mode,
+                       RedisStateStorage::PresenceMode presence_mode, RedisPub::Transport transport,
+                       const std::string& mesh_addr, const std::string& journal_path) {
     my_server_id = server_id;
+    _codec.setMode(frame_mode);
 
     unsigned int thread_num = std::thread::hardware_concurrency()*2;
-    _threadPool = std::make_unique<ThreadPool>(thread_num，18000);
+    _executor = std::make_unique<ShardedExecutor>(thread_num, 18000);
+    _dbExecutor = std::make_unique<ShardedExecutor>(kDbThreads, kDbQueueCapacity);
+    _deliveryExecutor = std::make_unique<ShardedExecutor>(std::max(2u, thread_num / 4), 65536);
+
+    // 离线消息、好友和群成员关系的写入先进入写回队列，由后台线程合并落库
+    // 启动失败时各处写入退回数据库执行器同步执行
+    _writeBehind = std::make_unique<WriteBehindQueue>();
+    if (!_writeBehind->start(journal_path)) {
+        LOG_ERROR << "Failed to start write-behind queue, writes go to the database directly.";
+    }
 
      // ================== 新增：初始化 RedisStateStorage ==================
     // 注意：请将这里的IP、端口和连接池大小替换为您的实际配置
@@ -46,18 +290,51 @@ void ChatService::init(const std::string& server_id) {
     int redis_port = 6379;
     size_t pool_size = 4; // 例如，创建一个大小为4的连接池
 
+    // 异步客户端由独立的 Redis 线程驱动，心跳续期、下线和单聊路由查询都不再阻塞业务线程
+    _asyncRedis = std::make_unique<AsyncRedisClient>(redis_ip, redis_port);
+    _asyncRedis->start();
+
     // 使用 make_unique 创建 RedisStateStorage 的实例
-    _RedisStateStorage = std::make_unique<RedisStateStorage>(pool_size, redis_ip, redis_port);
+    _RedisStateStorage = std::make_unique<RedisStateStorage>(pool_size, redis_ip, redis_port, _asyncRedis.get());
     LOG_INFO << "RedisStateStorage connection pool initialized.";
+
+    // 租约模式：本服务器持有一个续租的租约key，用户心跳不再逐个续期
+    if (presence_mode == RedisStateStorage::SERVER_LEASE && !_RedisStateStorage->enableServerLease(my_server_id)) {
+        LOG_ERROR << "Failed to enable server lease presence, falling back to per-user TTL.";
+    }
     // =================================================================
 
 
     // 将 Redis 连接和订阅的逻辑移到这里
     if (_redis.connect()) {
+        _redis.setAsyncPublisher(_asyncRedis.get());
+        _redis.setDeliveryExecutor(_deliveryExecutor.get());
+        // Streams 传输：聊天消息写入目标服务器的流，断线重连后可重放；在线状态事件仍走广播通道
+        if (transport == RedisPub::STREAMS && !_redis.enableStreams(my_server_id, {kPresenceChannel})) {
+            LOG_ERROR << "Failed to enable redis streams transport, using pub/sub.";
+        }
+        // 登记本服务器的接收方式，其他服务器据此为发往本机的消息选择 XADD 或 PUBLISH
+        _redis.advertiseTransport(my_server_id);
+        // 直连网格：入站帧按本服务器通道上报，与从 Redis 收到的帧走同一套解包和投递
+        if (!mesh_addr.empty()) {
+            _mesh = std::make_unique<PeerMesh>(my_server_id, mesh_addr, _RedisStateStorage.get());
+            if (_mesh->start([this](const char* data, size_t len) { _redis.dispatchInbound(my_server_id, data, len); })) {
+                PeerMesh* mesh = _mesh.get();
+                _redis.setDirectSender([mesh](const string& server) { return mesh->ready(server); },
+                                       [mesh](const string& server, const string& frame, direct_done done) {
+                                           mesh->send(server, frame, std::move(done));
+                                       }, {kPresenceChannel});
+            } else {
+                _mesh.reset();
+            }
+        }
+        // 发往同一服务器的跨服消息合并成批量帧发布，减少 Redis 命令数
+        // 刷新定时器在 Redis 线程中读取发送配置，因此放在传输方式和直连发送设置之后开启
+        _redis.enableBatching();
         _redis.init_notify_handler(std::bind(&ChatService::redis_subscribe_message_handler, this, _1, _2));
-        // 使用传入的 server_id 进行订阅
-        _redis.subscribe(my_server_id); 
-        LOG_INFO << "Subscribed to channel: " << my_server_id;
+        // 使用传入的 server_id 进行订阅，同时订阅在线状态事件的广播通道
+        _redis.subscribe(vector<string>{my_server_id, kPresenceChannel});
+        LOG_INFO << "Subscribed to channel: " << my_server_id << ", " << kPresenceChannel;
     } else {
         LOG_ERROR << "Failed to connect to Redis.";
     }
@@ -68,8 +345,34 @@ void ChatService::init(const std::string& server_id) {
  * @param channel 收到消息的频道（也就是我们自己的 server_id）
  * @param message 完整的消息内容（JSON字符串）
  */
+void ChatService::publishPresenceEvent(const std::string &event, long long userId)
+{
+    // 格式："login:<userid>"、"logout:<userid>" 或 "register:<userid>"
+    _redis.publish(kPresenceChannel, event + ":" + to_string(userId), userId);
+}
+
+void ChatService::handlePresenceEvent(const std::string &message)
+{
+    size_t pos = message.find(':');
+    if (pos == string::npos) {
+        return;
+    }
+    long long userId = atoll(message.c_str() + pos + 1);
+    // 新注册的用户：失效本机可能存在的负缓存
+    if (message.compare(0, pos, "register") == 0) {
+        _userCache.invalidate(userId);
+        return;
+    }
+    // 无论登录还是下线，该用户所在的服务器都可能变化，直接失效，下次路由时重新查询
+    _presenceCache.invalidate(userId);
+}
+
 void ChatService::redis_subscribe_message_handler(const string& channel, const string& message)
 {
+    if (channel == kPresenceChannel) {
+        handlePresenceEvent(message);
+        return;
+    }
        LOG_INFO << "========== REDIS SUB MSG RECEIVED ==========";
     LOG_INFO << "Channel: " << channel << ", Message: " << message;
     json js;
@@ -88,29 +391,22 @@ void ChatService::redis_subscribe_message_handler(const string& channel, const s
     if (js.contains("groupid"))
     {
         int groupId = js["groupid"].get<int>();
+        ChatPayloadPtr payload = makeChatPayload(_codec, js, message);
 
-        lock_guard<mutex> lock(_groupCacheMutex);
-        auto it = _localGroupCache.find(groupId);
-
-        if (it != _localGroupCache.end()) {
-            // 从缓存中直接获取本服务器上的所有群成员
-            const auto& localMemberSet = it->second;
-
-            // 向这些成员转发消息
-            lock_guard<mutex> connLock(_connMutex);
-            for (long long member_id : localMemberSet) {
-                auto conn_it = _userConnMap.find(member_id);
-                if (conn_it != _userConnMap.end()) {
-                     auto targetConn = conn_it->second;
-                    // ================== 核心修改 ==================
-                    targetConn->getLoop()->runInLoop([targetConn, message]() {
-                        targetConn->send(message);
-                    });
-                    //conn_it->second->send(message);
-                }
-                // 注意：这里不再需要处理离线逻辑，发送方已经处理过了
+        // 从缓存中直接获取本服务器上的所有群成员，批量收集这些成员的连接
+        // 注意：这里不再需要处理离线逻辑，发送方已经处理过了
+        vector<TcpConnectionPtr> targets;
+        {
+            lock_guard<mutex> lock(_groupCacheMutex);
+            auto it = _localGroupCache.find(groupId);
+            if (it != _localGroupCache.end()) {
+                _userConns.findBatch(it->second, targets);
             }
         }
+        // 释放群组缓存锁之后再向这些成员转发消息，多个投递线程不在扇出期间互相等待
+        if (!targets.empty()) {
+            fanOut(targets, payload);
+        }
         // 处理完毕，直接返回
         return; 
     }
@@ -119,17 +415,15 @@ void ChatService::redis_subscribe_message_handler(const string& channel, const s
     {
         long long toId = js["toid"].get<long long>();
         
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(toId);
-        if (it != _userConnMap.end())
+        TcpConnectionPtr targetConn = _userConns.find(toId);
+        if (targetConn)
         {
             // 用户就在本机，发送消息
-            //it->second->send(message);
-            auto targetConn = it->second;
             // ================== 核心修改 ==================
             // 从 Redis 线程调度回目标连接的 I/O 线程
-            targetConn->getLoop()->runInLoop([targetConn, message]() {
-                targetConn->send(message);
+            ChatPayloadPtr payload = makeChatPayload(_codec, js, message);
+            targetConn->getLoop()->runInLoop([this, targetConn, payload]() {
+                sendChatMessage(targetConn, *payload);
             });
         }
         else
@@ -137,7 +431,7 @@ void ChatService::redis_subscribe_message_handler(const string& channel, const s
              LOG_ERROR << "CRITICAL: Received message for user " << toId << " but they are NOT in the local connection map!";
             // 边界情况：消息在路由过程中，用户恰好下线了
             // 此时可以进行一次离线存储作为补偿
-            _offlineMsgModel.insert(toId, message);
+            storeOfflineMsg(toId, message);
         }
         // 处理完毕，直接返回
         return;
@@ -165,7 +459,7 @@ MsgHandler ChatService::getHandler(int msgId)
     if (it == _msgHandlerMap.end())
     {
         // 返回一个默认的处理器(lambda匿名函数，仅仅用作提示)
-        return [=](const TcpConnectionPtr &conn, json &js, Timestamp) {
+        return [=](const TcpConnectionPtr &, json &, Timestamp) {
             LOG_ERROR << "msgId: " << msgId << " can not find handler!";
         }; 
     }
@@ -187,40 +481,48 @@ void ChatService::reset()
  */
 void ChatService::clientCloseExceptionHandler(const TcpConnectionPtr &conn)
 {
-    // 尝试将 context 转换为 long long* (指向 long long 的指针)
-     const long long* user_id_ptr = any_cast<long long>(&conn->getContext());
+    // 取连接建立时绑定的会话，登录成功后其中记录了用户ID
+    const ChatSession* session = getSession(conn);
 
-    // 只有当转换成功 (指针不为 nullptr) 时，才执行后续逻辑
-    if (user_id_ptr != nullptr)
+    // 只有已登录的连接才执行后续逻辑
+    if (session != nullptr && session->userId != -1)
     {
-        long long user_id = *user_id_ptr; // 从指针解引用得到用户ID
+        long long user_id = session->userId; // 从会话中得到用户ID
 
         // 1. 清理本地用户连接表
-        {
-            lock_guard<mutex> lock(_connMutex);
-            _userConnMap.erase(user_id);
-        }
+        _userConns.erase(user_id);
 
-        // 2. 清理本地群组缓存
-        std::vector<Group> userGroups = _groupModel.queryGroups(user_id);
-        {
-            lock_guard<mutex> lock(_groupCacheMutex);
-            for (const auto& group : userGroups) {
-                auto it = _localGroupCache.find(group.getId());
-                if (it != _localGroupCache.end()) {
-                    it->second.erase(user_id);
-                    if (it->second.empty()) {
-                        _localGroupCache.erase(it);
-                    }
-                }
-            }
-        }
+        // 2. 清理本地群组缓存：群组ID在数据库线程中查询，不阻塞 I/O 线程
+        runDbAsync(user_id, [this, user_id]() { return _groupModel.queryGroupIds(user_id); },
+                   [this, user_id](const std::vector<int>& groupIds) { removeFromGroupCache(user_id, groupIds); });
         
         // 3. 更新 Redis 中的全局状态
-        _RedisStateStorage->setUserOffline(to_string(user_id));
+        _RedisStateStorage->setUserOfflineAsync(user_id);
+        publishPresenceEvent("logout", user_id);
+    }
+    // 这个连接从未成功登录过，我们什么都不用做，直接忽略即可。
+    // 登录进行中断开的连接由 resumeSession 补做清理
+}
+void ChatService::storeOfflineMsg(long long userId, const std::string &msg)
+{
+    // 优先进入写回队列；队列已满时退回数据库执行器，按接收者分片与其登录时的读取串行
+    if (!_writeBehind->appendOfflineMsg(userId, msg)) {
+        postDbWrite(static_cast<size_t>(userId), [this, userId, msg]() { _offlineMsgModel.insert(userId, msg); });
+    }
+}
+
+void ChatService::removeFromGroupCache(long long userId, const std::vector<int> &groupIds)
+{
+    lock_guard<mutex> lock(_groupCacheMutex);
+    for (int group_id : groupIds) {
+        auto it = _localGroupCache.find(group_id);
+        if (it != _localGroupCache.end()) {
+            it->second.erase(userId);
+            if (it->second.empty()) {
+                _localGroupCache.erase(it);
+            }
+        }
     }
-    // 如果 user_id_ptr 是 nullptr，说明 context 里是别的类型或为空，
-    // 意味着这个连接从未成功登录过，我们什么都不用做，直接忽略即可。
 }
 /*
 void ChatService::clientCloseExceptionHandler(const TcpConnectionPtr &conn)
@@ -255,228 +557,312 @@ void ChatService::clientCloseExceptionHandler(const TcpConnectionPtr &conn)
 /**
  * @brief 处理用户注销业务
  */
-void ChatService::logoutHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::logoutHandler(const TcpConnectionPtr &, json &js, Timestamp)
 {
     long long user_id = js["id"].get<long long>();
 
     // 1. 清理本地用户连接表
-    {
-        lock_guard<mutex> lock(_connMutex);
-        _userConnMap.erase(user_id);
-    }
+    _userConns.erase(user_id);
 
     // 2. 清理本地群组缓存
-    std::vector<Group> userGroups = _groupModel.queryGroups(user_id);
-    {
-        lock_guard<mutex> lock(_groupCacheMutex);
-        for (const auto& group : userGroups) {
-            auto it = _localGroupCache.find(group.getId());
-            if (it != _localGroupCache.end()) {
-                it->second.erase(user_id);
-                if (it->second.empty()) {
-                    _localGroupCache.erase(it);
-                }
-            }
-        }
-    }
+    runDbAsync(user_id, [this, user_id]() { return _groupModel.queryGroupIds(user_id); },
+               [this, user_id](const std::vector<int>& groupIds) { removeFromGroupCache(user_id, groupIds); });
     
     // 3. 更新 Redis 中的全局状态
-    _RedisStateStorage->setUserOffline(to_string(user_id));
+    _RedisStateStorage->setUserOfflineAsync(user_id);
+    publishPresenceEvent("logout", user_id);
 
     LOG_INFO << "User " << user_id << " logged out.";
 }
 // 一对一聊天业务
-void ChatService::oneChatHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::oneChatHandler(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
     // 需要接收信息的用户ID
     long long toId = js["toid"].get<long long>();
-     string messageToSend = js.dump();
+    ChatPayloadPtr payload = makeChatPayload(_codec, js);
+    // 同一发送者的消息必须按提交顺序发出：有未完成的 Redis 查询时，本地发送和缓存命中也排在它后面
+    size_t key = shardKey(conn);
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(toId);
+        TcpConnectionPtr targetConn = _userConns.find(toId);
         // 确认是在线状态
-        if (it != _userConnMap.end())
+        if (targetConn)
         {
-            // TcpConnection::send() 直接发送消息
-            auto targetConn = it->second;
-
-            // ================== 核心修改 ==================
             // 将发送给目标用户的操作，调度到目标用户连接所属的 I/O 线程
-            targetConn->getLoop()->runInLoop([targetConn, messageToSend]() {
-                targetConn->send(messageToSend);
+            routeInOrder(key, [this, targetConn, payload]() {
+                targetConn->getLoop()->runInLoop([this, targetConn, payload]() {
+                    sendChatMessage(targetConn, *payload);
+                });
             });
             return;
         }
     }
-    LOG_INFO << "User " << toId << " is not local. Preparing to query Redis state.";
     // 用户在其他主机的情况，publish消息到redis
-    //User user = _userModel.query(toId);
-    std::string server_id="";
-    bool is_online = _RedisStateStorage->getUserStatus(std::to_string(toId), server_id);
-    LOG_INFO << "server " << server_id << "  friend  is on?  "<<is_online;
-    if(is_online){
-        _redis.publish(server_id,js.dump());
+    // 热点会话的对方所在服务器通常已在本地缓存中，不需要查询Redis
+    std::string cached_server_id;
+    if (_presenceCache.get(toId, cached_server_id)) {
+        routeInOrder(key, [this, toId, payload, cached_server_id]() {
+            _redis.publish(cached_server_id, payload->json, toId);
+        });
         return;
     }
+    LOG_INFO << "User " << toId << " is not local. Preparing to query Redis state.";
+    // 异步查询目标用户所在的服务器，查询期间业务线程可以继续处理其他消息
+    // 先在发送者的路由队列中占位，结果回到发送者所在的分片后按占位顺序发出
+    std::shared_ptr<PendingRoute> pending = beginRoute(key);
+    uint64_t cacheVersion = _presenceCache.version(toId);
+    _RedisStateStorage->getUserStatusAsync(toId, [this, key, pending, cacheVersion, toId, payload](
+                                                     RedisStateStorage::UserStatus status, const std::string& server_id) {
+        auto route = [this, toId, payload, status, server_id, cacheVersion]() {
+            std::string target = server_id;
+            bool is_online = (status == RedisStateStorage::USER_ONLINE);
+            if (status == RedisStateStorage::STATUS_ERROR) {
+                // 异步连接断开或出错：在业务线程中用连接池同步再查一次，不把在线用户当作离线
+                LOG_WARN << "async presence lookup of user " << toId << " failed, retry synchronously";
+                is_online = _RedisStateStorage->getUserStatus(std::to_string(toId), target);
+            }
+            LOG_INFO << "server " << target << "  friend  is on?  " << is_online;
+            if (is_online) {
+                // 查询期间收到过该用户的登录/下线事件时不缓存这个可能过时的结果
+                _presenceCache.put(toId, target, cacheVersion);
+                _redis.publish(target, payload->json, toId);
+                return;
+            }
+            // toId 不在线则存储离线消息
+            storeOfflineMsg(toId, payload->json);
+        };
+        postFromRedis(key, [this, key, pending, route]() { completeRoute(key, pending, route); });
+    });
     /*
     if (user.getState() == "online")
     {
         _redis.publish(toId, js.dump());
         return;
     }*/
+}
+
+void ChatService::routeInOrder(size_t key, std::function<void()> route)
+{
+    {
+        lock_guard<mutex> lock(_routeMutex);
+        auto it = _pendingRoutes.find(key);
+        if (it != _pendingRoutes.end()) {
+            auto entry = std::make_shared<PendingRoute>();
+            entry->ready = true;
+            entry->route = std::move(route);
+            it->second.push_back(std::move(entry));
+            return;
+        }
+    }
+    route();
+}
 
-    // toId 不在线则存储离线消息
-    _offlineMsgModel.insert(toId, js.dump());
+std::shared_ptr<ChatService::PendingRoute> ChatService::beginRoute(size_t key)
+{
+    auto entry = std::make_shared<PendingRoute>();
+    lock_guard<mutex> lock(_routeMutex);
+    _pendingRoutes[key].push_back(entry);
+    return entry;
+}
+
+void ChatService::completeRoute(size_t key, const std::shared_ptr<PendingRoute> &entry, std::function<void()> route)
+{
+    // 取出队首所有已就绪的路由，在锁外按顺序执行；它们都在 key 的分片线程中执行，不会交错
+    std::vector<std::function<void()>> ready;
+    {
+        lock_guard<mutex> lock(_routeMutex);
+        entry->ready = true;
+        entry->route = std::move(route);
+        auto it = _pendingRoutes.find(key);
+        if (it == _pendingRoutes.end()) {
+            return;
+        }
+        auto &queue = it->second;
+        while (!queue.empty() && queue.front()->ready) {
+            ready.push_back(std::move(queue.front()->route));
+            queue.pop_front();
+        }
+        if (queue.empty()) {
+            _pendingRoutes.erase(it);
+        }
+    }
+    for (auto &r : ready) {
+        r();
+    }
 }
 
 // 添加朋友业务
-void ChatService::addFriendHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::addFriendHandler(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
     long long userId = js["id"].get<long long>();
     long long friendId = js["friendid"].get<long long>();
 
-    // 存储好友信息
-    _friendModel.insert(userId, friendId);
-    _friendModel.insert(friendId, userId);
+    auto reply = [this, conn, friendId]() {
+        json response;
+        response["msgid"] = ADD_FRIEND_MSG_ACK;
+        response["errno"] = 0;
+        response["friendid"] = friendId;
+        conn->getLoop()->runInLoop([this, conn, response]() {
+            _codec.send(conn, response.dump());
+        });
+    };
 
-    json response;
-    response["msgid"] = ADD_FRIEND_MSG_ACK;
-    response["errno"] = 0;
-    response["friendid"] = friendId;
-    //conn->send(response.dump());
-     conn->getLoop()->runInLoop([conn, response]() {
-        conn->send(response.dump());
+    // 存储好友信息：进入写回队列即可应答
+    if (_writeBehind->appendFriend(userId, friendId) && _writeBehind->appendFriend(friendId, userId)) {
+        reply();
+        return;
+    }
+    // 写回队列已满：在数据库线程中写入，完成后直接把应答交给连接的 I/O 线程
+    postDbWrite(shardKey(conn), [this, userId, friendId, reply]() {
+        _friendModel.insert(userId, friendId);
+        _friendModel.insert(friendId, userId);
+        reply();
     });
 }
 
 // 创建群组业务
-void ChatService::createGroup(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::createGroup(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
     long long userId = js["id"].get<long long>();
     std::string name = js["groupname"];
     std::string desc = js["groupdesc"];
 
-    // 存储新创建的群组消息
-    Group group(-1, name, desc);
-    json response; // 准备响应
-
-    if (_groupModel.createGroup(group))
-    {
-        // 存储群组创建人信息
-        _groupModel.addGroup(userId, group.getId(), "creator");
-        {
-            lock_guard<mutex> lock(_groupCacheMutex);
-            _localGroupCache[group.getId()].insert(userId);
+    // 存储新创建的群组消息和群组创建人信息，失败时返回的群组ID为 -1
+    runDbAsync(shardKey(conn), [this, userId, name, desc]() {
+        Group group(-1, name, desc);
+        if (_groupModel.createGroup(group)) {
+            _groupModel.addGroup(userId, group.getId(), "creator");
+        } else {
+            group.setId(-1);
         }
-
-        // 新增：向客户端发送创建成功的响应
+        return group.getId();
+    }, [this, conn, userId](int groupId) {
+        json response; // 准备响应
         response["msgid"] = CREATE_GROUP_MSG_ACK;
-        response["errno"] = 0;
-        response["groupid"] = group.getId(); // 把新群组的ID发给客户端
-        //conn->send(response.dump());
-         conn->getLoop()->runInLoop([conn, response]() {
-            conn->send(response.dump());
+        if (groupId != -1) {
+            {
+                lock_guard<mutex> lock(_groupCacheMutex);
+                _localGroupCache[groupId].insert(userId);
+            }
+            response["errno"] = 0;
+            response["groupid"] = groupId; // 把新群组的ID发给客户端
+        } else {
+            response["errno"] = 1;
+        }
+        conn->getLoop()->runInLoop([this, conn, response]() {
+            _codec.send(conn, response.dump());
         });
-    }
-    else
-    {
-        // 新增：发送失败的响应
-        response["msgid"] = CREATE_GROUP_MSG_ACK;
-        response["errno"] = 1;
-        //conn->send(response.dump());
-         conn->getLoop()->runInLoop([conn, response]() {
-                conn->send(response.dump());
-            });
-    }
+    });
 }
 
 // 加入群组业务
-void ChatService::addGroup(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::addGroup(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
     long long userId = js["id"].get<long long>();
     int groupId = js["groupid"].get<int>();
-    _groupModel.addGroup(userId, groupId, "normal");
     {
     lock_guard<mutex> lock(_groupCacheMutex);
     _localGroupCache[groupId].insert(userId);
     }
 
-    json response;
-    response["msgid"] = ADD_GROUP_MSG_ACK;
-    response["errno"] = 0;
-    response["groupid"] = groupId;
-    //conn->send(response.dump());
-    conn->getLoop()->runInLoop([conn, response]() {
-        conn->send(response.dump());
+    auto reply = [this, conn, groupId]() {
+        json response;
+        response["msgid"] = ADD_GROUP_MSG_ACK;
+        response["errno"] = 0;
+        response["groupid"] = groupId;
+        conn->getLoop()->runInLoop([this, conn, response]() {
+            _codec.send(conn, response.dump());
+        });
+    };
+
+    // 成员关系进入写回队列即可应答
+    if (_writeBehind->appendGroupMember(userId, groupId, "normal")) {
+        reply();
+        return;
+    }
+    // 写回队列已满：在数据库线程中写入，完成后直接把应答交给连接的 I/O 线程
+    postDbWrite(shardKey(conn), [this, userId, groupId, reply]() {
+        _groupModel.addGroup(userId, groupId, "normal");
+        reply();
     });
 }
 
 /**
  * @brief 处理群组聊天业务（重构优化后）
  */
-void ChatService::groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::groupChat(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
     long long userId = js["id"].get<long long>();
     int groupId = js["groupid"].get<int>();
-    string messageToSend = js.dump(); // 预先准备好要发送的消息
-    // 步骤 1: 从数据库获取所有群组成员的ID。这是唯一的一次DB查询。
-    std::vector<long long> userIdVec = _groupModel.queryGroupUsers(userId, groupId);
- 
-                std::unordered_map<long long, std::string> online_group_users = _RedisStateStorage->getUsersStatus(userIdVec);
+    // 预先把消息序列化为共享负载，整个扇出过程只序列化这一次
+    ChatPayloadPtr payload = makeChatPayload(_codec, js);
+    // 步骤 1: 从数据库获取所有群组成员的ID。这是唯一的一次DB查询，在数据库线程中执行，
+    // 查询结果回到发送者所在的分片继续扇出，同一发送者的群消息仍按提交顺序投递
+    runDbAsync(shardKey(conn), [this, userId, groupId]() { return _groupModel.queryGroupUsers(userId, groupId); },
+               [this, userId, groupId, payload](std::vector<long long>& userIdVec) {
+        deliverGroupChat(userId, groupId, payload, userIdVec);
+    });
+}
+
+void ChatService::deliverGroupChat(long long userId, int groupId, const ChatPayloadPtr &payload,
+                                   std::vector<long long> &userIdVec)
+{
+    // 不给自己发送消息
+    userIdVec.erase(std::remove(userIdVec.begin(), userIdVec.end(), userId), userIdVec.end());
+
+    // 步骤 2: 优先在本地批量查找，每个连接表分片只加一次锁
+    // 本机在线的成员连接稍后按 EventLoop 批量发送，其余成员再去Redis查询全局状态
+    std::vector<TcpConnectionPtr> local_targets;
+    std::vector<long long> non_local_ids;
+    _userConns.findBatch(userIdVec, local_targets, &non_local_ids);
 
+    std::unordered_map<long long, std::string> online_group_users = _RedisStateStorage->getUsersStatus(non_local_ids);
 
-    // 步骤 2: 批量处理和分发消息
     // 使用一个map来按服务器ID对远程用户进行分组，key为server_id, value为该服务器上的用户列表
     // 这是为了实现对每个远程服务器只发送一次消息的优化
     std::map<string, std::vector<long long>> remote_users_by_server;
+    // 不在线的成员，循环结束后一次性批量存储离线消息
+    std::vector<long long> offline_ids;
 
-    for (long long id : userIdVec)
+    for (long long id : non_local_ids)
     {
-        // 不给自己发送消息
-        if (id == userId) {
-            continue;
-        }
-
-        // 优先在本地查找
-        {
-            lock_guard<mutex> lock(_connMutex);
-            auto it = _userConnMap.find(id);
-            if (it != _userConnMap.end())
-            {
-                // 成员就在本机，直接发送
-                //it->second->send(js.dump());
-                 auto targetConn = it->second;
-                // ================== 核心修改 ==================
-                targetConn->getLoop()->runInLoop([targetConn, messageToSend]() {
-                    targetConn->send(messageToSend);
-                });
-                continue; // 处理下一个用户
-            }
-        }
-
-        // 本地未找到，查询Redis获取全局状态
-        //string server_id ="";
-
-        if (online_group_users.count(id))
+        auto it = online_group_users.find(id);
+        if (it != online_group_users.end())
         {
             // 用户在线，但在其他服务器上。将其加入待发送的map中。
-            // 这里我们暂时不需要存user_id列表，因为我们决定只发送一次消息
-            // 简单地用一个 set 记录需要通知的 server_id 即可
-            // (为了演示分组概念，我们仍用map，但实际可以简化)
-            remote_users_by_server[online_group_users[id]].push_back(id);
+            remote_users_by_server[it->second].push_back(id);
         }
         else
         {
-            // 用户不在线，存储离线消息
-            _offlineMsgModel.insert(id, js.dump());
+            // 用户不在线，稍后存储离线消息
+            offline_ids.push_back(id);
         }
     }
 
+    // 所有离线成员共用一条多行INSERT
+    if (!offline_ids.empty() && !_writeBehind->appendOfflineMsgs(offline_ids, payload->json)) {
+        // 写回队列已满：与 storeOfflineMsg 一样按接收者分片，保证与接收者登录时的读取串行；
+        // 落在同一个数据库分片的成员仍合并为一条INSERT
+        std::map<size_t, std::vector<long long>> offline_by_shard;
+        for (long long id : offline_ids) {
+            offline_by_shard[_dbExecutor->shardOf(static_cast<size_t>(id))].push_back(id);
+        }
+        for (auto &entry : offline_by_shard) {
+            std::vector<long long> ids = std::move(entry.second);
+            size_t key = static_cast<size_t>(ids.front());
+            postDbWrite(key, [this, ids, payload]() {
+                _offlineMsgModel.insertBatch(ids, payload->json);
+            });
+        }
+    }
+
+    // 本机成员：每个 EventLoop 只投递一次
+    fanOut(local_targets, payload);
+
     // 步骤 3: 对分组后的远程服务器，每个服务器只发送一次群聊消息
     for (auto const& [server_id, users] : remote_users_by_server)
     {
         // _redisPubSub->publish(server_id, js.dump()); // 假设 publish 接受 int
-        _redis.publish(server_id, js.dump()); // 如果 publish 接受 string
+        _redis.publish(server_id, payload->json, groupId);
     }
 }
 /*
@@ -524,205 +910,324 @@ void ChatService::groupChat(const TcpConnectionPtr &conn, json &js, Timestamp ti
  * {"errmsg":"this account is using, input another!","errno":2,"msgid":2}
  * @brief 处理登录业务（重构后）
  */
-void ChatService::loginHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::loginHandler(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
+    // 登录请求结束前连接上的后续消息都在暂存，请求不完整时也要结束登录
+    if (!js.contains("id") || !js.contains("password")) {
+        json response;
+        response["msgid"] = LOGIN_MSG_ACK;
+        response["errno"] = 1;
+        response["errmsg"] = "Invalid username or password!";
+        conn->getLoop()->runInLoop([this, conn, response]() {
+            _codec.send(conn, response.dump());
+        });
+        resumeSession(conn, -1, false);
+        return;
+    }
     long long id = js["id"].get<long long>(); // 使用 long long 保持一致
     std::string password = js["password"];
+    // 客户端在登录消息中携带 "wire":"binary" 请求二进制编码，仅长度头分帧下可用
+    bool binaryWire = js.contains("wire") && js["wire"] == "binary"
+                      && _codec.getMode() == ChatCodec::LENGTH_HEADER;
 
-    // 1. 身份认证：从数据库验证用户名和密码 (此步骤不变)
-    User user = _userModel.query(id);
-    if (user.getId() != -1 && user.getPassword() == password)
-    {
-        // 2. 全局在线状态检查：查询 Redis
-        string server_id ="";
-        if (_RedisStateStorage->getUserStatus(to_string(id), server_id))
+    // 1. 身份认证：校验密码
+    auto authenticate = [this, conn, id, password, binaryWire](const User& user) {
+        if (user.getId() != -1 && user.getPassword() == password)
         {
-            // 该用户已经在线（可能在任何一个服务器节点），拒绝重复登录
-            json response;
-            response["msgid"] = LOGIN_MSG_ACK;
-            response["errno"] = 2;
-            response["errmsg"] = "This account is already online, duplicate login is not allowed.";
-            //conn->send(response.dump());
-             conn->getLoop()->runInLoop([conn, response]() {
-                conn->send(response.dump());
-            });
+            // 2. 全局在线状态检查并宣告在线：由一个 Redis 脚本原子完成
+            // 并发的重复登录只有一个能占有成功；Redis 出错时 server_id 为空，按未在线处理
+            // _my_server_id 是当前服务器实例的ID，应从配置中读取
+            string server_id ="";
+            if (!_RedisStateStorage->tryClaimUser(id, my_server_id, server_id) && !server_id.empty())
+            {
+                // 该用户已经在线（可能在任何一个服务器节点），拒绝重复登录
+                json response;
+                response["msgid"] = LOGIN_MSG_ACK;
+                response["errno"] = 2;
+                response["errmsg"] = "This account is already online, duplicate login is not allowed.";
+                //conn->send(response.dump());
+                 conn->getLoop()->runInLoop([this, conn, response]() {
+                    _codec.send(conn, response.dump());
+                });
+                resumeSession(conn, -1, false);
+            }
+            else
+            {
+                // === 登录成功，开始处理在线状态和业务数据 ===
+
+                // 3a. 在连接的 I/O 线程中把用户ID写入会话、记录用户在本服务器的连接，
+                // 并放行登录期间暂存的消息
+                resumeSession(conn, id, binaryWire);
+
+                // 3c. 全局在线状态已在步骤2中写入，通知其他服务器失效该用户的缓存
+                publishPresenceEvent("login", id);
+
+                // 3d. 在数据库线程中一次加载群组、第一页离线消息和好友列表，之后的消息按用户ID分片
+                runDbAsync(static_cast<size_t>(id), [this, id]() {
+                    // 先等写回队列中已入队的写入落库，离线消息和好友关系才完整
+                    if (!_writeBehind->sync(kWriteBehindSyncTimeout)) {
+                        LOG_WARN << "write-behind queue is lagging, login of user " << id << " may miss recent writes";
+                    }
+                    LoginData data;
+                    data.groups = _groupModel.queryGroups(id);
+                    // 离线消息只取第一页，登录应答之后下发，客户端确认后再删除并下发下一页
+                    data.offlinePage = _offlineMsgModel.queryPage(id, 0, kOfflinePageRows);
+                    data.friends = _friendModel.query(id);
+                    return data;
+                }, [this, conn, user, binaryWire](LoginData& data) {
+                    finishLogin(conn, user, binaryWire, data);
+                });
+            }
         }
         else
         {
-            // === 登录成功，开始处理在线状态和业务数据 ===
+            // 认证失败
+            json response;
+            response["msgid"] = LOGIN_MSG_ACK;
+            response["errno"] = 1;
+            response["errmsg"] = "Invalid username or password!";
+            conn->getLoop()->runInLoop([this, conn, response]() {
+                    _codec.send(conn, response.dump());
+                });
+            resumeSession(conn, -1, false);
+        }
+    };
 
-            // 3a. 绑定连接与用户ID，为了高效处理下线
-            conn->setContext(id);
+    // 用户资料优先从本地缓存读取，命中时不经过数据库线程，直接在当前分片中认证
+    User cached;
+    if (_userCache.get(id, cached)) {
+        authenticate(cached);
+        return;
+    }
+    // 未命中时在数据库线程中查询并回填缓存，结果回到本连接的分片中认证；查询出错时不缓存
+    uint64_t version = _userCache.version(id);
+    runDbAsync(shardKey(conn), [this, id, version]() {
+        User user;
+        if (_userModel.query(id, user)) {
+            _userCache.put(id, user, version);
+        }
+        return user;
+    }, authenticate);
+}
 
-            // 3b. 记录用户在本服务器的连接信息 (线程安全)
-            {
-                lock_guard<mutex> lock(_connMutex);
-                _userConnMap.insert({id, conn});
+void ChatService::finishLogin(const TcpConnectionPtr &conn, const User &user, bool binaryWire, LoginData &data)
+{
+    long long id = user.getId();
+    std::vector<Group> &userGroups = data.groups;
+
+    // 3d. 填充本地群组缓存
+    {
+        lock_guard<mutex> lock(_groupCacheMutex);
+        for (const auto& group : userGroups) {
+            _localGroupCache[group.getId()].insert(id);
+        }
+    }
+
+    // 4. 构造成功响应
+    json response;
+    response["msgid"] = LOGIN_MSG_ACK;
+    response["errno"] = 0;
+    response["id"] = user.getId();
+    response["name"] = user.getName();
+    response["wire"] = binaryWire ? "binary" : "json";
+
+    // 4a. 离线消息不再放入登录应答，登录应答发出后再逐页下发（见 sendOfflinePage）
+
+    // 4b. 好友列表已在数据库线程中拉取，这里查询其实时状态
+    std::vector<User> &friends = data.friends;
+    if (!friends.empty())
+    {
+        std::vector<long long> friend_ids;
+        friend_ids.reserve(friends.size());
+        for (const auto& friend_user : friends) {
+            friend_ids.push_back(friend_user.getId());
+        }
+        std::unordered_map<long long, std::string> online_friends = _RedisStateStorage->getUsersStatus(friend_ids);
+
+        json friends_json_array = json::array();
+        for (auto& friend_user : friends)
+        {
+            json friend_json;
+            friend_json["id"] = friend_user.getId();
+            friend_json["name"] = friend_user.getName();
+            // 关键: 从Redis查询好友的实时状态
+             if (online_friends.count(friend_user.getId())) {
+                friend_json["state"] = "online";
+            } else {
+                friend_json["state"] = "offline";
             }
+            friends_json_array.push_back(friend_json);
+        }
+        response["friends"] = friends_json_array;
+    }
 
-            // 3c. 宣告全局在线：向Redis写入状态信息，并设置过期时间
-            // _my_server_id 是当前服务器实例的ID，应从配置中读取
-            _RedisStateStorage->setUserOnline(to_string(id), my_server_id);
+    // 4c. 拉取群组信息 (userGroups 已在步骤 3d 获取)
+    // 4c. 拉取群组信息 (userGroups 已在步骤 3d 获取)
+    if (!userGroups.empty()) {
+        // === 优化点：批量获取所有群成员的在线状态 ===
 
-            // 3d. 填充本地群组缓存
-            std::vector<Group> userGroups = _groupModel.queryGroups(id);
-            {
-                lock_guard<mutex> lock(_groupCacheMutex);
-                for (const auto& group : userGroups) {
-                    _localGroupCache[group.getId()].insert(id);
-                }
+        // 1. 收集所有群组中所有成员的唯一ID
+        std::unordered_set<long long> all_member_ids;
+        for (auto& group : userGroups) {
+            for (auto& user : group.getUsers()) {
+                all_member_ids.insert(user.getId());
             }
+        }
 
-            // 4. 构造成功响应
-            json response;
-            response["msgid"] = LOGIN_MSG_ACK;
-            response["errno"] = 0;
-            response["id"] = user.getId();
-            response["name"] = user.getName();
+        // 2. 一次性从 Redis 查询所有这些成员的在线状态
+        std::vector<long long> member_id_vec(all_member_ids.begin(), all_member_ids.end());
+        std::unordered_map<long long, std::string> online_statuses = _RedisStateStorage->getUsersStatus(member_id_vec);
 
-            // 4a. 拉取离线消息 (逻辑不变)
-            /*std::vector<std::string> offlineMsgs = _offlineMsgModel.query(id);
-            if (!offlineMsgs.empty())
-            {
+        // 3. 构建 JSON 响应，从内存map中获取状态
+        json groups_json_array = json::array();
+        for (auto& group : userGroups) {
+            json group_json;
+            group_json["id"] = group.getId();
+            group_json["name"] = group.getName();
+            group_json["desc"] = group.getDesc();
+            
+            json users_json_array = json::array();
+            for (auto& user : group.getUsers()) {
+                json group_user_json;
+                group_user_json["id"] = user.getId();
+                group_user_json["name"] = user.getName();
                 
-                response["offlinemsg"] = offlineMsgs;
-                _offlineMsgModel.remove(id);
-            }*/
-           std::vector<std::string> offlineMsgs_str = _offlineMsgModel.query(id);
-            if (!offlineMsgs_str.empty())
-            {
-                // === 修改点 3: 优化JSON结构，避免客户端二次解析 ===
-                json offline_msgs_json_array = json::array();
-                for(const auto& str : offlineMsgs_str) {
-                    // 服务器自己先解析，然后将JSON对象放入数组
-                    offline_msgs_json_array.push_back(json::parse(str, nullptr, false));
+                // 从预先获取的 map 中高效查找状态，而不是再次查询Redis
+                if (online_statuses.count(user.getId())) {
+                    group_user_json["state"] = "online";
+                } else {
+                    group_user_json["state"] = "offline";
                 }
-                response["offlinemsg"] = offline_msgs_json_array;
-                _offlineMsgModel.remove(id);
+                users_json_array.push_back(group_user_json);
             }
+            group_json["users"] = users_json_array;
+            groups_json_array.push_back(group_json);
+        }
+        response["groups"] = groups_json_array;
+    }
+    conn->getLoop()->runInLoop([this, conn, response]() {
+        _codec.send(conn, response.dump());
+    });
 
-            // 4b. 拉取好友列表并查询其实时状态
-            std::vector<User> friends = _friendModel.query(id);
-            if (!friends.empty())
-            {
-                std::vector<long long> friend_ids;
-                friend_ids.reserve(friends.size());
-                for (const auto& friend_user : friends) {
-                    friend_ids.push_back(friend_user.getId());
-                }
-                std::unordered_map<long long, std::string> online_friends = _RedisStateStorage->getUsersStatus(friend_ids);
-
-                json friends_json_array = json::array();
-                for (auto& friend_user : friends)
-                {
-                    json friend_json;
-                    friend_json["id"] = friend_user.getId();
-                    friend_json["name"] = friend_user.getName();
-                    // 关键: 从Redis查询好友的实时状态
-                     if (online_friends.count(friend_user.getId())) {
-                        friend_json["state"] = "online";
-                    } else {
-                        friend_json["state"] = "offline";
-                    }
-                    friends_json_array.push_back(friend_json);
-                }
-                response["friends"] = friends_json_array;
-            }
+    // 5. 下发第一页离线消息：同一线程投递到同一 EventLoop 的任务按序执行，客户端先收到登录应答
+    sendOfflinePage(conn, data.offlinePage);
+}
 
-            // 4c. 拉取群组信息 (userGroups 已在步骤 3d 获取)
-            // 4c. 拉取群组信息 (userGroups 已在步骤 3d 获取)
-            if (!userGroups.empty()) {
-                // === 优化点：批量获取所有群成员的在线状态 ===
+void ChatService::sendOfflinePage(const TcpConnectionPtr &conn, std::vector<OfflineMsg> &page)
+{
+    if (page.empty()) {
+        return;
+    }
 
-                // 1. 收集所有群组中所有成员的唯一ID
-                std::unordered_set<long long> all_member_ids;
-                for (auto& group : userGroups) {
-                    for (auto& user : group.getUsers()) {
-                        all_member_ids.insert(user.getId());
-                    }
-                }
+    // 按字节数截断，至少保留一条
+    size_t count = 0;
+    size_t bytes = 0;
+    while (count < page.size() && (count == 0 || bytes + page[count].msg.size() <= kOfflinePageBytes)) {
+        bytes += page[count].msg.size();
+        ++count;
+    }
 
-                // 2. 一次性从 Redis 查询所有这些成员的在线状态
-                std::vector<long long> member_id_vec(all_member_ids.begin(), all_member_ids.end());
-                std::unordered_map<long long, std::string> online_statuses = _RedisStateStorage->getUsersStatus(member_id_vec);
-
-                // 3. 构建 JSON 响应，从内存map中获取状态
-                json groups_json_array = json::array();
-                for (auto& group : userGroups) {
-                    json group_json;
-                    group_json["id"] = group.getId();
-                    group_json["name"] = group.getName();
-                    group_json["desc"] = group.getDesc();
-                    
-                    json users_json_array = json::array();
-                    for (auto& user : group.getUsers()) {
-                        json group_user_json;
-                        group_user_json["id"] = user.getId();
-                        group_user_json["name"] = user.getName();
-                        
-                        // 从预先获取的 map 中高效查找状态，而不是再次查询Redis
-                        if (online_statuses.count(user.getId())) {
-                            group_user_json["state"] = "online";
-                        } else {
-                            group_user_json["state"] = "offline";
-                        }
-                        users_json_array.push_back(group_user_json);
-                    }
-                    group_json["users"] = users_json_array;
-                    groups_json_array.push_back(group_json);
-                }
-                response["groups"] = groups_json_array;
-            }
-            conn->getLoop()->runInLoop([conn, response]() {
-                conn->send(response.dump());
-            });
+    // 存储的是服务器自己序列化的JSON文本，直接拼接进页面，不再逐条解析再序列化
+    // 页面在 Buffer 中就地构造，发送时只补帧头：{"msgid":N,"lastid":N,"more":b,"msgs":[m1,m2,...]}
+    // 查询满一页或按字节截断时可能还有后续消息，客户端确认后再查询下一页
+    bool more = count < page.size() || page.size() >= static_cast<size_t>(kOfflinePageRows);
+    std::string head = "{\"msgid\":" + std::to_string(OFFLINE_MSG_PAGE)
+                     + ",\"lastid\":" + std::to_string(page[count - 1].id)
+                     + ",\"more\":" + (more ? "true" : "false") + ",\"msgs\":[";
+    auto body = std::make_shared<Buffer>();
+    body->ensureWritableBytes(head.size() + bytes + count + 2);
+    body->append(head);
+    bool first = true;
+    for (size_t i = 0; i < count; ++i) {
+        const std::string &msg = page[i].msg;
+        // 跳过不是JSON对象的脏数据，以免整页无法解析；它们随本页一起被确认删除
+        if (msg.size() < 2 || msg.front() != '{' || msg.back() != '}') {
+            LOG_ERROR << "skip malformed offline message " << page[i].id;
+            continue;
+        }
+        if (!first) {
+            body->append(",", 1);
         }
+        body->append(msg);
+        first = false;
     }
-    else
-    {
-        // 认证失败
-        json response;
-        response["msgid"] = LOGIN_MSG_ACK;
-        response["errno"] = 1;
-        response["errmsg"] = "Invalid username or password!";
-        conn->getLoop()->runInLoop([conn, response]() {
-                conn->send(response.dump());
-            });
+    body->append("]}", 2);
+
+    // 先登记在途的页再发送，确认不会先于登记到达
+    ChatSession* session = getSession(conn);
+    if (session != nullptr) {
+        session->offlinePageLastId = page[count - 1].id;
+    }
+    conn->getLoop()->runInLoop([this, conn, body]() {
+        _codec.send(conn, body.get());
+    });
+}
+
+/**
+ * @brief 处理客户端对一页离线消息的确认：删除已确认的消息并下发下一页
+ * 每个连接同时只有一页在途，积压再多也不会一次占满连接的发送缓冲区
+ */
+void ChatService::offlineMsgAckHandler(const TcpConnectionPtr &conn, json &js, Timestamp)
+{
+    ChatSession* session = getSession(conn);
+    if (session == nullptr || session->userId == -1 || !js.contains("lastid") || !js["lastid"].is_number_integer()) {
+        return;
+    }
+    // 取走在途的页：没有在途的页时忽略（重复或伪造的确认），确认最多到本页最后一条，
+    // 不会删除尚未下发给客户端的消息
+    long long sentLastId = session->offlinePageLastId.exchange(-1);
+    if (sentLastId == -1) {
+        LOG_WARN << "ignore offline ack without an outstanding page from " << conn->name();
+        return;
     }
+    long long lastId = js["lastid"].get<long long>();
+    if (lastId > sentLastId) {
+        LOG_WARN << "clamp offline ack " << lastId << " to sent page end " << sentLastId << " from " << conn->name();
+        lastId = sentLastId;
+    }
+    // 只删除当前登录用户自己的消息
+    long long userId = session->userId;
+
+    runDbAsync(static_cast<size_t>(userId), [this, userId, lastId]() {
+        _offlineMsgModel.removeUpTo(userId, lastId);
+        return _offlineMsgModel.queryPage(userId, lastId, kOfflinePageRows);
+    }, [this, conn](std::vector<OfflineMsg>& page) {
+        if (conn->connected()) {
+            sendOfflinePage(conn, page);
+        }
+    });
 }
 // 注册业务
-void ChatService::registerHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::registerHandler(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
     LOG_DEBUG << "do regidster service!";
 
     std::string name = js["name"];
     std::string password = js["password"];
-    json response;
-    User user;
-    user.setName(name);
-    user.setPassword(password);
-    bool state = _userModel.insert(user);
-    if (state)
-    {
-        // 注册成功
-        
-        response["msgid"] = REGISTER_MSG_ACK;
-        response["errno"] = 0;
-        response["id"] = user.getId();
-        // json::dump() 将序列化信息转换为std::string
-        //conn->send(response.dump());
-    }
-    else
-    {
-        // 注册失败
+    // 注册不涉及业务状态，写入完成后在数据库线程中直接把应答交给连接的 I/O 线程
+    postDbWrite(shardKey(conn), [this, conn, name, password]() {
         json response;
+        User user;
+        user.setName(name);
+        user.setPassword(password);
+        bool state = _userModel.insert(user);
         response["msgid"] = REGISTER_MSG_ACK;
-        response["errno"] = 1;
-        // 注册已经失败，不需要在json返回id
-        //conn->send(response.dump());
-    }
-     conn->getLoop()->runInLoop([conn, response]() {
-        conn->send(response.dump());
+        if (state)
+        {
+            // 注册成功：该ID此前可能被本机或其他服务器负缓存为"不存在"
+            _userCache.invalidate(user.getId());
+            publishPresenceEvent("register", user.getId());
+            response["errno"] = 0;
+            response["id"] = user.getId();
+        }
+        else
+        {
+            // 注册失败，不需要在json返回id
+            response["errno"] = 1;
+        }
+        conn->getLoop()->runInLoop([this, conn, response]() {
+            _codec.send(conn, response.dump());
+        });
     });
 }
 
@@ -730,21 +1235,18 @@ void ChatService::registerHandler(const TcpConnectionPtr &conn, json &js, Timest
 /**
  * @brief 处理客户端心跳消息
  */
-void ChatService::heartbeatHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::heartbeatHandler(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
     long long userid_from_json = js["id"].get<long long>();
     
-    // 同样，使用 muduo 的 any_cast
-    const long long* context_userid_ptr = any_cast<long long>(&conn->getContext());
+    const ChatSession* session = getSession(conn);
 
-    if (context_userid_ptr != nullptr) 
+    if (session != nullptr && session->userId != -1) 
     {
-        long long context_userid = *context_userid_ptr;
+        long long context_userid = session->userId;
         if (context_userid == userid_from_json) {
-             bool success = _RedisStateStorage->refreshUserTTL(context_userid, 60);
-             if (!success) {
-                LOG_INFO << "TTL refresh failed for user " << context_userid << ", maybe already offline.";
-             }
+             // 续期结果在 Redis 线程中检查，业务线程不等待应答
+             _RedisStateStorage->refreshUserTTLAsync(context_userid, 60);
         }
     }
 }
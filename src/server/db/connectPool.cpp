@@ -1,7 +1,178 @@
 #include "connectPool.hpp"
+#include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
 #include <muduo/base/Logging.h>
 #include <thread>
 #include <functional>
+#include <cstring>
+
+/////////////////////////////////////////////////////////////////////
+//          PreparedStatement 类的实现
+/////////////////////////////////////////////////////////////////////
+
+PreparedStatement::PreparedStatement(MYSQL_STMT *stmt)
+    : _stmt(stmt), _valid(true), _errno(0)
+{
+    size_t count = mysql_stmt_param_count(_stmt);
+    _params.resize(count);
+    _intValues.resize(count);
+    _lengths.resize(count);
+    memset(_params.data(), 0, sizeof(MYSQL_BIND) * count);
+}
+
+PreparedStatement::~PreparedStatement()
+{
+    mysql_stmt_close(_stmt);
+}
+
+void PreparedStatement::bindInt(int index, int value)
+{
+    bindInt64(index, value);
+}
+
+void PreparedStatement::bindInt64(int index, long long value)
+{
+    _intValues[index] = value;
+    MYSQL_BIND &bind = _params[index];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_LONGLONG;
+    bind.buffer = &_intValues[index];
+}
+
+void PreparedStatement::bindString(int index, const string &value)
+{
+    _lengths[index] = value.size();
+    MYSQL_BIND &bind = _params[index];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = const_cast<char*>(value.data());
+    bind.buffer_length = value.size();
+    bind.length = &_lengths[index];
+}
+
+bool PreparedStatement::bindAndExecute()
+{
+    if ((!_params.empty() && mysql_stmt_bind_param(_stmt, _params.data())) ||
+        mysql_stmt_execute(_stmt))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << " 预处理语句执行失败! error: " << mysql_stmt_error(_stmt);
+        _errno = mysql_stmt_errno(_stmt);
+        _valid = false;
+        return false;
+    }
+    _errno = 0;
+    return true;
+}
+
+bool PreparedStatement::rejected() const
+{
+    // 客户端错误码（连接失败、连接断开等）说明语句没有到达服务器或结果未知
+    if (_errno == 0 || (_errno >= CR_MIN_ERROR && _errno <= CR_MAX_ERROR))
+    {
+        return false;
+    }
+    // 服务器返回的暂时性错误，稍后重试可能成功
+    switch (_errno)
+    {
+    case ER_CON_COUNT_ERROR:
+    case ER_SERVER_SHUTDOWN:
+    case ER_LOCK_WAIT_TIMEOUT:
+    case ER_LOCK_DEADLOCK:
+    case ER_OPTION_PREVENTS_STATEMENT: // 只读实例，例如主从切换期间
+    case ER_QUERY_INTERRUPTED:
+        return false;
+    default:
+        return true;
+    }
+}
+
+bool PreparedStatement::execute()
+{
+    return bindAndExecute();
+}
+
+bool PreparedStatement::query(vector<vector<string>> &rows)
+{
+    if (!bindAndExecute())
+    {
+        return false;
+    }
+
+    MYSQL_RES *meta = mysql_stmt_result_metadata(_stmt);
+    if (meta == nullptr)
+    {
+        return true; // 没有结果集
+    }
+    unsigned int fieldCount = mysql_num_fields(meta);
+    mysql_free_result(meta);
+
+    // 每列先分配一个较小的缓冲区，超长的列在取数据时按实际长度再取一次
+    const unsigned long kInitColumnSize = 256;
+    vector<MYSQL_BIND> results(fieldCount);
+    vector<string> buffers(fieldCount, string(kInitColumnSize, '\0'));
+    vector<unsigned long> lengths(fieldCount);
+    vector<mysql_bool> isNull(fieldCount);
+    memset(results.data(), 0, sizeof(MYSQL_BIND) * fieldCount);
+    for (unsigned int i = 0; i < fieldCount; ++i)
+    {
+        results[i].buffer_type = MYSQL_TYPE_STRING;
+        results[i].buffer = &buffers[i][0];
+        results[i].buffer_length = kInitColumnSize;
+        results[i].length = &lengths[i];
+        results[i].is_null = &isNull[i];
+    }
+
+    if (mysql_stmt_bind_result(_stmt, results.data()) || mysql_stmt_store_result(_stmt))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << " 预处理语句取结果失败! error: " << mysql_stmt_error(_stmt);
+        mysql_stmt_free_result(_stmt);
+        _valid = false;
+        return false;
+    }
+
+    int status;
+    while ((status = mysql_stmt_fetch(_stmt)) == 0 || status == MYSQL_DATA_TRUNCATED)
+    {
+        vector<string> row(fieldCount);
+        for (unsigned int i = 0; i < fieldCount; ++i)
+        {
+            if (isNull[i])
+            {
+                continue;
+            }
+            if (lengths[i] <= kInitColumnSize)
+            {
+                row[i].assign(buffers[i].data(), lengths[i]);
+                continue;
+            }
+
+            // 该列被截断，按实际长度单独取出
+            row[i].resize(lengths[i]);
+            MYSQL_BIND column;
+            memset(&column, 0, sizeof(column));
+            column.buffer_type = MYSQL_TYPE_STRING;
+            column.buffer = &row[i][0];
+            column.buffer_length = lengths[i];
+            mysql_stmt_fetch_column(_stmt, &column, i, 0);
+        }
+        rows.push_back(std::move(row));
+    }
+
+    mysql_stmt_free_result(_stmt);
+    return status == MYSQL_NO_DATA;
+}
+
+unsigned long long PreparedStatement::insertId() const
+{
+    return mysql_stmt_insert_id(_stmt);
+}
+
+unsigned long long PreparedStatement::affectedRows() const
+{
+    return mysql_stmt_affected_rows(_stmt);
+}
 
 /////////////////////////////////////////////////////////////////////
 //          MySQL 类的实现
@@ -11,8 +182,44 @@ MySQL::MySQL(MYSQL* conn) : _conn(conn) {}
 
 MySQL::~MySQL()
 {
-    // 注意：这里的析构函数不再需要 mysql_close(_conn)
-    // 连接的关闭由 ConnectionPool 的析构函数统一管理
+    // MySQL 对象与物理连接同生命周期，由连接池在回收连接时析构
+    // 先关闭该连接上缓存的预处理语句，再关闭连接
+    _statements.clear();
+    if (_conn != nullptr)
+    {
+        mysql_close(_conn);
+    }
+}
+
+PreparedStatement* MySQL::prepare(const string &sql)
+{
+    auto it = _statements.find(sql);
+    if (it != _statements.end())
+    {
+        if (it->second->valid())
+        {
+            return it->second.get();
+        }
+        // 上次执行失败的语句可能已经失效，丢弃后重新预处理
+        _statements.erase(it);
+    }
+
+    MYSQL_STMT *stmt = mysql_stmt_init(_conn);
+    if (stmt == nullptr)
+    {
+        return nullptr;
+    }
+    if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size()))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << sql << " 预处理失败! error: " << mysql_stmt_error(stmt);
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+
+    PreparedStatement *ps = new PreparedStatement(stmt);
+    _statements[sql].reset(ps);
+    return ps;
 }
 
 bool MySQL::update(string sql)
@@ -70,6 +277,18 @@ bool ConnectionPool::loadConfigFile()
     return true;
 }
 
+MySQL* ConnectionPool::createConnection()
+{
+    MYSQL *p = mysql_init(nullptr);
+    if (p && mysql_real_connect(p, _ip.c_str(), _user.c_str(), _password.c_str(), 
+                               _dbname.c_str(), _port, nullptr, 0)) {
+        mysql_set_character_set(p, "utf8");
+        return new MySQL(p);
+    }
+    if (p) mysql_close(p);
+    return nullptr;
+}
+
 ConnectionPool::ConnectionPool() : _connectionCount(0), _stop(false)
 {
     if (!loadConfigFile()) {
@@ -79,14 +298,11 @@ ConnectionPool::ConnectionPool() : _connectionCount(0), _stop(false)
 
     // 创建初始数量的连接
     for (int i = 0; i < _initSize; ++i) {
-        MYSQL *p = mysql_init(nullptr);
-        if (p && mysql_real_connect(p, _ip.c_str(), _user.c_str(), _password.c_str(), 
-                                   _dbname.c_str(), _port, nullptr, 0)) {
-            mysql_set_character_set(p, "utf8");
+        MySQL *p = createConnection();
+        if (p) {
             _connectionQueue.push({p, chrono::steady_clock::now()});
             _connectionCount++;
         } else {
-            if (p) mysql_close(p);
             LOG_ERROR << "create initial mysql connection failed!";
         }
     }
@@ -109,9 +325,9 @@ ConnectionPool::~ConnectionPool()
     lock_guard<mutex> lock(_queueMutex);
     while(!_connectionQueue.empty())
     {
-        MYSQL* p = _connectionQueue.front().first;
+        MySQL* p = _connectionQueue.front().first;
         _connectionQueue.pop();
-        mysql_close(p);
+        delete p;
     }
 }
 
@@ -124,7 +340,7 @@ void ConnectionPool::produceConnectionTask()
         // 只有当队列为空，且总连接数小于最大值时，才生产
         // 如果队列不为空，则生产者应该睡眠，等待被消费者唤醒
         _producer.wait(lock, [&]() {
-            return _connectionQueue.size() < _initSize || _connectionCount >= _maxSize || _stop;
+            return _connectionQueue.size() < static_cast<size_t>(_initSize) || _connectionCount >= _maxSize || _stop;
         });
 
         if (_stop) {
@@ -133,16 +349,13 @@ void ConnectionPool::produceConnectionTask()
 
         // 队列为空，可以生产新连接
         if (_connectionCount < _maxSize) {
-            MYSQL *p = mysql_init(nullptr);
-            if (p && mysql_real_connect(p, _ip.c_str(), _user.c_str(), _password.c_str(), 
-                                       _dbname.c_str(), _port, nullptr, 0)) {
-                mysql_set_character_set(p, "utf8");
+            MySQL *p = createConnection();
+            if (p) {
                 _connectionQueue.push({p, chrono::steady_clock::now()});
                 _connectionCount++;
                 // 生产出一个，通知消费者可以来取了
                 _cv.notify_all(); 
             } else {
-                 if (p) mysql_close(p);
                  // 稍等片刻再尝试，避免因数据库瞬间无法连接而导致CPU空转
                  this_thread::sleep_for(chrono::milliseconds(500));
             }
@@ -174,9 +387,9 @@ void ConnectionPool::scannerConnectionTask()
             // 如果连接的空闲时间超过了阈值
             if (idle_duration.count() >= _maxIdleTime)
             {
-                MYSQL* p = conn_pair.first;
+                MySQL* p = conn_pair.first;
                 _connectionQueue.pop();
-                mysql_close(p);
+                delete p;
                 _connectionCount--;
             }
             else
@@ -206,16 +419,16 @@ shared_ptr<MySQL> ConnectionPool::getConnection()
     }
 
     // 从队列中取出一个连接
-    MYSQL* conn = _connectionQueue.front().first;
+    MySQL* conn = _connectionQueue.front().first;
     _connectionQueue.pop();
 
-    // 使用自定义删除器，当 shared_ptr 析构时，将连接归还给连接池
-    shared_ptr<MySQL> sp(new MySQL(conn), [this](MySQL* pconn){
+    // 使用自定义删除器，当 shared_ptr 析构时，将连接（连同其语句缓存）归还给连接池
+    shared_ptr<MySQL> sp(conn, [this](MySQL* pconn){
         if (pconn == nullptr) return;
         
         lock_guard<mutex> lock(_queueMutex);
         // 归还时，记录当前时间点
-        _connectionQueue.push({pconn->getConnection(), chrono::steady_clock::now()});
+        _connectionQueue.push({pconn, chrono::steady_clock::now()});
         // 通知其他可能在等待连接的线程
         _cv.notify_one(); 
     });
@@ -1,25 +1,30 @@
 #include "chatserver.hpp"
 #include "chatservice.hpp"
 #include <muduo/base/Logging.h>
-#include "ThreadPool.hpp"
 #include <iostream>
 #include <signal.h>
 using namespace std;
 
+// 主 EventLoop，收到 SIGINT 后退出循环，由 main 完成收尾
+static EventLoop *g_loop = nullptr;
+
 // 捕获SIGINT的处理函数
 void resetHandler(int)
 {
     LOG_INFO << "capture the SIGINT, will reset state\n";
     //ChatService::instance()->reset();
-    exit(0);
+    if (g_loop != nullptr) {
+        g_loop->quit();
+    } else {
+        exit(0);
+    }
 }
 
-ThreadPool g_threadPool(4); // 比如，创建一个有4个工作线程的线程池
 // main.cpp
 int main(int argc, char **argv)
 {
     if (argc < 3) {
-        cerr << "command invalid! example: ./ChatServer <port> <server_name>" << endl;
+        cerr << "command invalid! example: ./ChatServer <port> <server_name> [length|line] [ttl|lease] [pubsub|streams] [mesh_host:mesh_port|-] [journal_path]" << endl;
         exit(-1);
     }
 
@@ -28,8 +33,38 @@ int main(int argc, char **argv)
     uint16_t port = atoi(argv[1]);
     std::string server_name = argv[2];
 
+    // 帧格式：默认4字节长度头，"line" 为兼容旧客户端的换行分隔JSON
+    ChatCodec::FrameMode frame_mode = ChatCodec::LENGTH_HEADER;
+    if (argc > 3 && std::string(argv[3]) == "line") {
+        frame_mode = ChatCodec::LINE_DELIMITED;
+    }
+
+    // 在线状态：默认每个用户一个TTL key，"lease" 为服务器租约模式
+    RedisStateStorage::PresenceMode presence_mode = RedisStateStorage::PER_USER_TTL;
+    if (argc > 4 && std::string(argv[4]) == "lease") {
+        presence_mode = RedisStateStorage::SERVER_LEASE;
+    }
+
+    // 跨服务器消息传输：默认 pub/sub，"streams" 为可重放的 Redis Streams
+    RedisPub::Transport transport = RedisPub::PUBSUB;
+    if (argc > 5 && std::string(argv[5]) == "streams") {
+        transport = RedisPub::STREAMS;
+    }
+
+    // 服务器直连网格：其他服务器连接本机使用的 "host:port"，不指定则跨服务器消息只经 Redis 转发
+    std::string mesh_addr;
+    if (argc > 6 && std::string(argv[6]) != "-") {
+        mesh_addr = argv[6];
+    }
+
+    // 写回队列的本地日志：指定后未落库的写入在崩溃重启时重放
+    std::string journal_path;
+    if (argc > 7) {
+        journal_path = argv[7];
+    }
+
     // === 关键修改：在启动前初始化单例 ===
-    ChatService::instance()->init(server_name);
+    ChatService::instance()->init(server_name, frame_mode, presence_mode, transport, mesh_addr, journal_path);
 
     EventLoop loop;
     InetAddress addr(port);
@@ -37,7 +72,11 @@ int main(int argc, char **argv)
     ChatServer server(&loop, addr, "ChatServer");
 
     server.start();
+    g_loop = &loop;
     loop.loop();
+    g_loop = nullptr;
 
+    // 刷出写回队列后再退出
+    ChatService::instance()->shutdown();
     return 0;
 }
\ No newline at end of file
@@ -1,49 +1,101 @@
 #include "friendmodel.hpp"
 #include "connectPool.hpp"
+#include <algorithm>
+
+// 多行INSERT预处理语句每条最多包含的行数
+static const size_t kInsertBatchRows = 32;
+
+// 生成 insert ignore into friend values(?, ?),(?, ?)... 共rows行
+static std::string makeInsertSql(size_t rows)
+{
+    std::string sql = "insert ignore into friend values";
+    for (size_t i = 0; i < rows; ++i)
+    {
+        sql += (i == 0) ? "(?, ?)" : ",(?, ?)";
+    }
+    return sql;
+}
 
 // 添加好友关系
 void FriendModel::insert(long long userId, long long friendId)
 {
-    // 组织sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into friend values(%lld, %lld)", userId, friendId);
-
     //MySQL mysql;
      shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
     if (mysql)
     {
-        mysql->update(sql);
+        PreparedStatement *stmt = mysql->prepare("insert into friend values(?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt64(0, userId);
+            stmt->bindInt64(1, friendId);
+            stmt->execute();
+        }
     }
 }
 
-// 返回用户好友列表
-std::vector<User> FriendModel::query(long long userId)
+// 批量添加好友关系
+size_t FriendModel::insertBatch(const std::vector<std::pair<long long, long long>> &rows, bool *rejected)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
+    shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
+    if (!mysql)
+    {
+        return 0;
+    }
 
-    // 联合查询
-    sprintf(sql, "select a.id, a.name from user a inner join friend b on b.friendid = a.id where b.userid=%lld", userId);
+    size_t written = 0;
+    while (written < rows.size())
+    {
+        size_t count = std::min(kInsertBatchRows, rows.size() - written);
+        PreparedStatement *stmt = mysql->prepare(makeInsertSql(count));
+        if (stmt == nullptr)
+        {
+            break;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            stmt->bindInt64(static_cast<int>(i * 2), rows[written + i].first);
+            stmt->bindInt64(static_cast<int>(i * 2 + 1), rows[written + i].second);
+        }
+        if (!stmt->execute())
+        {
+            if (rejected != nullptr)
+            {
+                *rejected = stmt->rejected();
+            }
+            break;
+        }
+        written += count;
+    }
+    return written;
+}
 
+// 返回用户好友列表
+std::vector<User> FriendModel::query(long long userId)
+{
     std::vector<User> vec;
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
     if (mysql)
     {
-        MYSQL_RES *res = mysql->query(sql);
-        if (res != nullptr)
+        // 联合查询
+        PreparedStatement *stmt = mysql->prepare(
+            "select a.id, a.name from user a inner join friend b on b.friendid = a.id where b.userid = ?");
+        if (stmt == nullptr)
+        {
+            return vec;
+        }
+        stmt->bindInt64(0, userId);
+
+        vector<vector<string>> rows;
+        if (stmt->query(rows))
         {
-            // 把userid用户的所有离线消息放入vec中返回
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            for (const vector<string> &row : rows)
             {
                 User user;
-                user.setId(atoi(row[0]));
+                user.setId(atoll(row[0].c_str()));
                 user.setName(row[1]);
                 //user.setState(row[2]);
                 vec.push_back(user);
             }
-            mysql_free_result(res);
-            return vec;
         }
     }
     return vec;
@@ -1,20 +1,40 @@
 #include "group_model.hpp"
 #include "connectPool.hpp"
+#include <algorithm>
+
+// 多行INSERT预处理语句每条最多包含的行数
+static const size_t kInsertBatchRows = 32;
+
+// 生成 insert ignore into groupuser values(?, ?, ?),... 共rows行
+static std::string makeAddGroupSql(size_t rows)
+{
+    std::string sql = "insert ignore into groupuser values";
+    for (size_t i = 0; i < rows; ++i)
+    {
+        sql += (i == 0) ? "(?, ?, ?)" : ",(?, ?, ?)";
+    }
+    return sql;
+}
 
 // 创建群组（设置群组名字和描述）
 bool GroupModel::createGroup(Group &group)
 {
     // insert into allgroup(groupname, groupdesc) values('chat-server', 'test for create group2');
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into allgroup(groupname, groupdesc) values('%s', '%s')",
-        group.getName().c_str(), group.getDesc().c_str());
-    
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
     if (mysql)
     {
-        if (mysql->update(sql))
+        PreparedStatement *stmt = mysql->prepare("insert into allgroup(groupname, groupdesc) values(?, ?)");
+        if (stmt == nullptr)
         {
-            group.setId(mysql_insert_id(mysql->getConnection()));
+            return false;
+        }
+        const std::string name = group.getName();
+        const std::string desc = group.getDesc();
+        stmt->bindString(0, name);
+        stmt->bindString(1, desc);
+        if (stmt->execute())
+        {
+            group.setId(stmt->insertId());
             return true;
         }
     }
@@ -25,98 +45,158 @@ bool GroupModel::createGroup(Group &group)
 // 加入群组（用户ID 加入群组ID 在群组角色）
 void GroupModel::addGroup(long long userid, int groupid, std::string role)
 {
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into groupuser values(%d, %lld, '%s')",
-        groupid, userid, role.c_str());
-    
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
     if (mysql)
     {
-        mysql->update(sql);
+        PreparedStatement *stmt = mysql->prepare("insert into groupuser values(?, ?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, groupid);
+            stmt->bindInt64(1, userid);
+            stmt->bindString(2, role);
+            stmt->execute();
+        }
+    }
+}
+
+// 批量加入群组
+size_t GroupModel::addGroupBatch(const std::vector<GroupMemberRow> &rows, bool *rejected)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
+    if (!mysql)
+    {
+        return 0;
+    }
+
+    size_t written = 0;
+    while (written < rows.size())
+    {
+        size_t count = std::min(kInsertBatchRows, rows.size() - written);
+        PreparedStatement *stmt = mysql->prepare(makeAddGroupSql(count));
+        if (stmt == nullptr)
+        {
+            break;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            const GroupMemberRow &row = rows[written + i];
+            stmt->bindInt(static_cast<int>(i * 3), row.groupid);
+            stmt->bindInt64(static_cast<int>(i * 3 + 1), row.userid);
+            stmt->bindString(static_cast<int>(i * 3 + 2), row.role);
+        }
+        if (!stmt->execute())
+        {
+            if (rejected != nullptr)
+            {
+                *rejected = stmt->rejected();
+            }
+            break;
+        }
+        written += count;
     }
+    return written;
 }
 
 // 查询用户所在群组信息
 std::vector<Group> GroupModel::queryGroups(long long userid)
 {
-    /**
-     * // TODO:MySQL联表查询
-     * 1. 先根据userid在groupuser表中查询出该用户所属的群组信息
-     * 2. 再根据群组信息，查询属于该群组的所有用户的userid，并且和user表进行多表联合查询，查出用户的详细信息
-    */
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "select a.id,a.groupname,a.groupdesc from allgroup a inner join \
-        groupuser b on a.id = b.groupid where b.userid=%lld",
-        userid);
-    
     std::vector<Group> groupVec;
 
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
     if (mysql)
     {
-        MYSQL_RES *res = mysql->query(sql);
-        if (res != nullptr)
+        /**
+         * 一次联表查询同时取出群组和群成员，避免每个群组再查询一次成员（N+1查询）：
+         * b: 该用户所在的群组关系  a: 群组信息  m: 这些群组的全部成员关系  u: 成员的用户信息
+         * 结果按群组id排序，同一群组的成员行连续出现
+        */
+        PreparedStatement *stmt = mysql->prepare("select a.id,a.groupname,a.groupdesc,u.id,u.name,m.grouprole \
+            from groupuser b inner join allgroup a on a.id = b.groupid \
+            inner join groupuser m on m.groupid = a.id \
+            inner join user u on u.id = m.userid \
+            where b.userid = ? order by a.id");
+        if (stmt == nullptr)
+        {
+            return groupVec;
+        }
+        stmt->bindInt64(0, userid);
+
+        vector<vector<string>> rows;
+        if (stmt->query(rows))
         {
-            MYSQL_ROW row;
-            // 查出userid所有的群组信息
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            for (const vector<string> &row : rows)
             {
-                Group group;
-                group.setId(atoi(row[0]));
-                group.setName(row[1]);
-                group.setDesc(row[2]);
-                groupVec.push_back(group);
+                int groupid = atoi(row[0].c_str());
+                // 遇到新的群组id时创建群组对象
+                if (groupVec.empty() || groupVec.back().getId() != groupid)
+                {
+                    Group group;
+                    group.setId(groupid);
+                    group.setName(row[1]);
+                    group.setDesc(row[2]);
+                    groupVec.push_back(group);
+                }
+
+                GroupUser user;
+                user.setId(atoll(row[3].c_str()));
+                user.setName(row[4]);
+                user.setRole(row[5]);
+                groupVec.back().getUsers().push_back(user);
             }
-            mysql_free_result(res);
         }
     }
+    return groupVec;
+}
 
-    // 查询群组的用户信息
-    for (Group &group : groupVec)
+// 查询用户所在群组的id
+std::vector<int> GroupModel::queryGroupIds(long long userid)
+{
+    std::vector<int> idVec;
+    shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
+    if (mysql)
     {
-        snprintf(sql, sizeof(sql), "select a.id,a.name,b.grouprole from user a \
-            inner join groupuser b on b.userid = a.id where b.groupid=%d",
-                group.getId());
+        PreparedStatement *stmt = mysql->prepare("select groupid from groupuser where userid = ?");
+        if (stmt == nullptr)
+        {
+            return idVec;
+        }
+        stmt->bindInt64(0, userid);
 
-        MYSQL_RES *res = mysql->query(sql);
-        if (res != nullptr)
+        vector<vector<string>> rows;
+        if (stmt->query(rows))
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            for (const vector<string> &row : rows)
             {
-                GroupUser user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-               // user.setState(row[2]);
-                user.setRole(row[3]);
-                group.getUsers().push_back(user);
+                idVec.push_back(atoi(row[0].c_str()));
             }
-            mysql_free_result(res);
         }
     }
-    return groupVec;
+    return idVec;
 }
 
 // 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
 std::vector<long long> GroupModel::queryGroupUsers(long long userid, int groupid)
 {
-    char sql[1024] = {0};
-    sprintf(sql, "select userid from groupuser where groupid = %d and userid != %lld", groupid, userid);
-
     vector<long long> idVec;
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
     if (mysql)
     {
-        MYSQL_RES *res = mysql->query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare("select userid from groupuser where groupid = ? and userid != ?");
+        if (stmt == nullptr)
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            return idVec;
+        }
+        stmt->bindInt(0, groupid);
+        stmt->bindInt64(1, userid);
+
+        vector<vector<string>> rows;
+        if (stmt->query(rows))
+        {
+            for (const vector<string> &row : rows)
             {
-                idVec.push_back(atoi(row[0]));
+                idVec.push_back(atoll(row[0].c_str()));
             }
-            mysql_free_result(res);
         }
     }
     return idVec;  
-}
\ No newline at end of file
+}
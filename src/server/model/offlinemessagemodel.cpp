@@ -1,56 +1,181 @@
 #include "offlinemessagemodel.hpp"
 #include "connectPool.hpp"
+#include <algorithm>
+
+// 多行INSERT预处理语句每条最多包含的行数
+// 不同行数的语句各自缓存在连接上，行数固定可以让整批和余数两种语句都被复用
+static const size_t kInsertBatchRows = 32;
+
+// 生成 insert into offlinemessage(userid, message) values(?, ?),(?, ?)... 共rows行
+static std::string makeInsertSql(size_t rows)
+{
+    std::string sql = "insert into offlinemessage(userid, message) values";
+    for (size_t i = 0; i < rows; ++i)
+    {
+        sql += (i == 0) ? "(?, ?)" : ",(?, ?)";
+    }
+    return sql;
+}
+
 // 存储用户的离线消息
-void OfflineMsgModel::insert(long long userId, std::string msg)
+void OfflineMsgModel::insert(long long userId, const std::string &msg)
 {
-    // 组织sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into offlinemessage values(%lld, '%s')", userId, msg.c_str());
+    insertBatch(std::vector<long long>{userId}, msg);
+}
+
+// 批量存储离线消息
+void OfflineMsgModel::insertBatch(const std::vector<long long> &userIds, const std::string &msg)
+{
+    if (userIds.empty())
+    {
+        return;
+    }
 
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
-    if (mysql)
+    if (!mysql)
     {
-        mysql->update(sql);
+        return;
+    }
+
+    // 按 kInsertBatchRows 行一组执行，每行绑定的是同一个消息字符串，不需要转义和拷贝
+    for (size_t begin = 0; begin < userIds.size(); begin += kInsertBatchRows)
+    {
+        size_t rows = std::min(kInsertBatchRows, userIds.size() - begin);
+        PreparedStatement *stmt = mysql->prepare(makeInsertSql(rows));
+        if (stmt == nullptr)
+        {
+            return;
+        }
+        for (size_t i = 0; i < rows; ++i)
+        {
+            stmt->bindInt64(static_cast<int>(i * 2), userIds[begin + i]);
+            stmt->bindString(static_cast<int>(i * 2 + 1), msg);
+        }
+        stmt->execute();
     }
 }
 
+// 批量存储各不相同的离线消息
+size_t OfflineMsgModel::insertRows(const std::vector<std::pair<long long, const std::string*>> &rows, bool *rejected)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
+    if (!mysql)
+    {
+        return 0;
+    }
+
+    size_t written = 0;
+    while (written < rows.size())
+    {
+        size_t count = std::min(kInsertBatchRows, rows.size() - written);
+        PreparedStatement *stmt = mysql->prepare(makeInsertSql(count));
+        if (stmt == nullptr)
+        {
+            break;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            stmt->bindInt64(static_cast<int>(i * 2), rows[written + i].first);
+            stmt->bindString(static_cast<int>(i * 2 + 1), *rows[written + i].second);
+        }
+        if (!stmt->execute())
+        {
+            if (rejected != nullptr)
+            {
+                *rejected = stmt->rejected();
+            }
+            break;
+        }
+        written += count;
+    }
+    return written;
+}
+
 // 删除用户的离线消息
 void OfflineMsgModel::remove(long long userId)
 {
-    // 组织sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "delete from offlinemessage where userid=%lld", userId);
+    shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
+    if (mysql)
+    {
+        PreparedStatement *stmt = mysql->prepare("delete from offlinemessage where userid = ?");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt64(0, userId);
+            stmt->execute();
+        }
+    }
+}
 
+// 删除用户已确认的离线消息
+void OfflineMsgModel::removeUpTo(long long userId, long long maxId)
+{
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
     if (mysql)
     {
-        mysql->update(sql);
+        PreparedStatement *stmt = mysql->prepare("delete from offlinemessage where userid = ? and id <= ?");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt64(0, userId);
+            stmt->bindInt64(1, maxId);
+            stmt->execute();
+        }
     }
 }
 
 // 查询用户的离线消息
 std::vector<std::string> OfflineMsgModel::query(long long userId)
 {
-    // 组织sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "select message from offlinemessage where userid = %lld", userId);
-
     std::vector<std::string> vec;
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
     if (mysql)
     {
-        MYSQL_RES *res = mysql->query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare("select message from offlinemessage where userid = ?");
+        if (stmt == nullptr)
         {
-            // 把userid用户的所有消息放入vec中返回
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            return vec;
+        }
+        stmt->bindInt64(0, userId);
+
+        // 把userid用户的所有消息放入vec中返回
+        vector<vector<string>> rows;
+        if (stmt->query(rows))
+        {
+            for (vector<string> &row : rows)
             {
-                vec.push_back(row[0]);
+                vec.push_back(std::move(row[0]));
             }
-            mysql_free_result(res);
+        }
+    }
+    return vec;
+}
+
+// 分页查询用户的离线消息
+std::vector<OfflineMsg> OfflineMsgModel::queryPage(long long userId, long long afterId, int limit)
+{
+    std::vector<OfflineMsg> vec;
+    shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
+    if (mysql)
+    {
+        // 走 (userid, id) 索引，每页的代价与积压的消息总数无关
+        PreparedStatement *stmt = mysql->prepare(
+            "select id, message from offlinemessage where userid = ? and id > ? order by id limit ?");
+        if (stmt == nullptr)
+        {
             return vec;
         }
+        stmt->bindInt64(0, userId);
+        stmt->bindInt64(1, afterId);
+        stmt->bindInt(2, limit);
+
+        vector<vector<string>> rows;
+        if (stmt->query(rows))
+        {
+            vec.reserve(rows.size());
+            for (vector<string> &row : rows)
+            {
+                vec.push_back(OfflineMsg{atoll(row[0].c_str()), std::move(row[1])});
+            }
+        }
     }
     return vec;
 }
@@ -4,17 +4,21 @@
 
 bool UserModel::insert(User& user)
 {
-    // 组装sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into user(name, password) values('%s', '%s')",
-        user.getName().c_str(), user.getPassword().c_str());
-
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
     if (mysql)
     {
-        if (mysql->update(sql))
+        PreparedStatement *stmt = mysql->prepare("insert into user(name, password) values(?, ?)");
+        if (stmt == nullptr)
+        {
+            return false;
+        }
+        const std::string name = user.getName();
+        const std::string password = user.getPassword();
+        stmt->bindString(0, name);
+        stmt->bindString(1, password);
+        if (stmt->execute())
         {
-            user.setId(mysql_insert_id(mysql->getConnection()));
+            user.setId(stmt->insertId());
             return true;
         }
     }
@@ -25,33 +29,41 @@ bool UserModel::insert(User& user)
 // 根据用户号码查询用户信息
 User UserModel::query(long long id)
 {
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "select * from user where id = %lld", id);
+    User user;
+    query(id, user);
+    return user;
+}
 
+bool UserModel::query(long long id, User &user)
+{
+    user = User();
     shared_ptr<MySQL> mysql = ConnectionPool::getInstance()->getConnection();
-    if (mysql)
+    if (!mysql)
     {
-        MYSQL_RES *res = mysql->query(sql);
-        if (res != nullptr)
-        {
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row != nullptr)
-            {
-                // 生成一个User对象，填入信息
-                User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setPassword(row[2]);
-                //user.setState(row[3]);
-                mysql_free_result(res);
-                return user;
-            }
-        }
+        return false;
+    }
 
+    PreparedStatement *stmt = mysql->prepare("select id, name, password from user where id = ?");
+    if (stmt == nullptr)
+    {
+        return false;
     }
+    stmt->bindInt64(0, id);
 
-    // 返回空User
-    return User();
+    vector<vector<string>> rows;
+    if (!stmt->query(rows))
+    {
+        return false;
+    }
+    if (!rows.empty())
+    {
+        // 填入用户信息；没有结果行时保持空User
+        user.setId(atoll(rows[0][0].c_str()));
+        user.setName(rows[0][1]);
+        user.setPassword(rows[0][2]);
+        //user.setState(row[3]);
+    }
+    return true;
 }
 /*
 bool UserModel::updateState(User user)
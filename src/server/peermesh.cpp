@@ -0,0 +1,235 @@
+#include "peermesh.hpp"
+#include <muduo/base/Logging.h>
+#include <future>
+#include <cstring>
+
+// 对端没有登记地址（未开启网格）时，隔多久再重新查询
+static const std::chrono::seconds kResolveRetryInterval(5);
+
+// 握手帧：2字节魔数 + 发送方服务器ID；与批量帧、JSON消息都不会混淆
+static const char kHelloMagic[2] = {'\0', 'H'};
+static const size_t kHelloMagicLen = sizeof(kHelloMagic);
+
+PeerMesh::PeerMesh(const std::string &serverId, const std::string &advertiseAddr, RedisStateStorage *storage)
+    : _serverId(serverId), _advertiseAddr(advertiseAddr), _storage(storage),
+      _loopThread(EventLoopThread::ThreadInitCallback(), "MeshLoop"), _loop(nullptr),
+      _codec(ChatCodec::LENGTH_HEADER)
+{
+}
+
+PeerMesh::~PeerMesh()
+{
+    if (_loop == nullptr)
+    {
+        return;
+    }
+
+    _storage->unregisterServerAddress(_serverId);
+
+    // TcpServer 和 TcpClient 必须在所属的 EventLoop 线程中析构
+    runInLoopAndWait([this]() {
+        std::unordered_map<std::string, PeerLink> peers;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            peers.swap(_peers);
+        }
+        peers.clear();
+        _server.reset();
+    });
+    // 析构连接时投递的回调还在队列中，等它们执行完再释放成员
+    runInLoopAndWait([]() {});
+}
+
+bool PeerMesh::parseAddress(const std::string &address, std::string &host, uint16_t &port)
+{
+    size_t pos = address.rfind(':');
+    if (pos == std::string::npos || pos == 0 || pos + 1 == address.size())
+    {
+        return false;
+    }
+    int value = atoi(address.c_str() + pos + 1);
+    if (value <= 0 || value > 65535)
+    {
+        return false;
+    }
+    host = address.substr(0, pos);
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+bool PeerMesh::start(FrameHandler handler)
+{
+    std::string host;
+    uint16_t port = 0;
+    if (!parseAddress(_advertiseAddr, host, port))
+    {
+        LOG_ERROR << "invalid mesh address " << _advertiseAddr << ", expect host:port";
+        return false;
+    }
+
+    _handler = std::move(handler);
+    _loop = _loopThread.startLoop();
+    runInLoopAndWait([this, port]() {
+        _server.reset(new TcpServer(_loop, InetAddress(port), "ChatMesh"));
+        _server->setMessageCallback(std::bind(&PeerMesh::onInboundMessage, this, _1, _2, _3));
+        _server->start();
+    });
+
+    if (!_storage->registerServerAddress(_serverId, _advertiseAddr))
+    {
+        LOG_ERROR << "register mesh address failed, peers will keep routing through redis";
+    }
+    LOG_INFO << "mesh listening on " << _advertiseAddr;
+    return true;
+}
+
+bool PeerMesh::ready(const std::string &serverId)
+{
+    bool needResolve = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        PeerLink &link = _peers[serverId];
+        if (link.conn)
+        {
+            return true;
+        }
+        if (!link.client && !link.resolving && Clock::now() >= link.retryAfter)
+        {
+            link.resolving = true;
+            needResolve = true;
+        }
+    }
+
+    if (needResolve)
+    {
+        // 地址查询结果回到网格线程中建立链路，此前的消息仍走 Redis
+        _storage->getServerAddressAsync(serverId, [this, serverId](const std::string &address) {
+            _loop->runInLoop([this, serverId, address]() { connectPeerInLoop(serverId, address); });
+        });
+    }
+    return false;
+}
+
+void PeerMesh::send(const std::string &serverId, const std::string &frame, SendDone done)
+{
+    // 执行时才取链路：提交之后链路断开的帧交还调用方，不会写到已关闭的连接上悄悄丢失
+    _loop->runInLoop([this, serverId, frame, done]() {
+        TcpConnectionPtr conn;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _peers.find(serverId);
+            if (it != _peers.end())
+            {
+                conn = it->second.conn;
+            }
+        }
+        if (conn && conn->connected())
+        {
+            _codec.send(conn, frame);
+            done(true);
+        }
+        else
+        {
+            done(false);
+        }
+    });
+}
+
+void PeerMesh::connectPeerInLoop(const std::string &serverId, const std::string &address)
+{
+    std::string host;
+    uint16_t port = 0;
+    std::lock_guard<std::mutex> lock(_mutex);
+    PeerLink &link = _peers[serverId];
+    link.resolving = false;
+    if (address.empty() || !parseAddress(address, host, port))
+    {
+        link.retryAfter = Clock::now() + kResolveRetryInterval;
+        return;
+    }
+
+    // 链路建立后保持长连接，断开后由 TcpClient 自动重连
+    link.client.reset(new TcpClient(_loop, InetAddress(host, port), "MeshLink-" + serverId));
+    link.client->setConnectionCallback([this, serverId](const TcpConnectionPtr &conn) {
+        onPeerConnection(serverId, conn);
+    });
+    link.client->enableRetry();
+    link.client->connect();
+    LOG_INFO << "mesh connecting to " << serverId << " at " << address;
+}
+
+void PeerMesh::onPeerConnection(const std::string &serverId, const TcpConnectionPtr &conn)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _peers.find(serverId);
+    if (it == _peers.end())
+    {
+        return;
+    }
+    if (conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        // 握手帧先于任何数据帧写出：数据帧只在链路登记之后、同一网格线程中写出
+        std::string hello(kHelloMagic, kHelloMagicLen);
+        hello += _serverId;
+        _codec.send(conn, hello);
+        it->second.conn = conn;
+    }
+    else
+    {
+        // 断开期间发往该服务器的帧退回 Redis
+        it->second.conn.reset();
+    }
+}
+
+bool PeerMesh::acceptHello(const TcpConnectionPtr &conn, const std::string &frame)
+{
+    if (frame.size() <= kHelloMagicLen || memcmp(frame.data(), kHelloMagic, kHelloMagicLen) != 0)
+    {
+        LOG_ERROR << "mesh peer " << conn->peerAddress().toIpPort() << " sent data before hello, shutdown";
+        return false;
+    }
+    std::string peerId = frame.substr(kHelloMagicLen);
+    if (peerId == _serverId)
+    {
+        LOG_ERROR << "mesh peer " << conn->peerAddress().toIpPort() << " claims our own server id, shutdown";
+        return false;
+    }
+    conn->setContext(peerId);
+    LOG_INFO << "mesh peer " << peerId << " connected from " << conn->peerAddress().toIpPort();
+    return true;
+}
+
+void PeerMesh::onInboundMessage(const TcpConnectionPtr &conn, Buffer *buffer, Timestamp)
+{
+    std::string frame;
+    ChatCodec::DecodeResult result;
+    while ((result = _codec.retrieveFrame(buffer, frame)) == ChatCodec::FRAME_OK)
+    {
+        // 上下文为空表示尚未握手
+        if (!conn->getContext().has_value())
+        {
+            if (!acceptHello(conn, frame))
+            {
+                conn->shutdown();
+                return;
+            }
+            continue;
+        }
+        _handler(frame.data(), frame.size());
+    }
+    if (result == ChatCodec::FRAME_INVALID)
+    {
+        conn->shutdown();
+    }
+}
+
+void PeerMesh::runInLoopAndWait(const std::function<void()> &fn)
+{
+    std::promise<void> done;
+    _loop->runInLoop([&fn, &done]() {
+        fn();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
@@ -0,0 +1,76 @@
+#include "presencecache.hpp"
+
+PresenceCache::PresenceCache(size_t capacity, std::chrono::milliseconds ttl)
+    : _shardCapacity(capacity / kShardCount + 1), _ttl(ttl)
+{
+}
+
+bool PresenceCache::get(long long userId, std::string &serverId)
+{
+    Shard &shard = _shards[shardIndex(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(userId);
+    if (it == shard.entries.end())
+    {
+        return false;
+    }
+    if (it->second.expireAt <= Clock::now())
+    {
+        shard.entries.erase(it);
+        return false;
+    }
+    serverId = it->second.serverId;
+    return true;
+}
+
+uint64_t PresenceCache::version(long long userId)
+{
+    Shard &shard = _shards[shardIndex(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.versions[versionSlot(userId)];
+}
+
+void PresenceCache::put(long long userId, const std::string &serverId, uint64_t version)
+{
+    Clock::time_point now = Clock::now();
+    Shard &shard = _shards[shardIndex(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // 查询期间该用户（或同一版本槽的其他用户）被失效过，查询结果可能已经过时
+    if (shard.versions[versionSlot(userId)] != version)
+    {
+        return;
+    }
+
+    if (shard.entries.size() >= _shardCapacity && shard.entries.find(userId) == shard.entries.end())
+    {
+        // 分片已满：先清掉过期条目，仍然满时淘汰任意一个
+        for (auto it = shard.entries.begin(); it != shard.entries.end(); )
+        {
+            if (it->second.expireAt <= now)
+            {
+                it = shard.entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        if (shard.entries.size() >= _shardCapacity)
+        {
+            shard.entries.erase(shard.entries.begin());
+        }
+    }
+
+    Entry &entry = shard.entries[userId];
+    entry.serverId = serverId;
+    entry.expireAt = now + _ttl;
+}
+
+void PresenceCache::invalidate(long long userId)
+{
+    Shard &shard = _shards[shardIndex(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.entries.erase(userId);
+    ++shard.versions[versionSlot(userId)];
+}
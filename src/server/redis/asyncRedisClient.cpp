@@ -0,0 +1,240 @@
+#include "asyncRedisClient.hpp"
+#include <muduo/base/Logging.h>
+#include <future>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// 断线或连接失败后的重连间隔（秒）
+static const double kReconnectInterval = 1.0;
+
+AsyncRedisClient::AsyncRedisClient(const std::string &ip, int port)
+    : _ip(ip), _port(port), _loopThread(EventLoopThread::ThreadInitCallback(), "RedisLoop"),
+      _loop(nullptr), _context(nullptr), _stopping(false)
+{
+}
+
+AsyncRedisClient::~AsyncRedisClient()
+{
+    if (_loop == nullptr)
+    {
+        return;
+    }
+
+    // 在 Redis 线程中释放连接：未完成的命令会以 nullptr 应答回调
+    // 等待释放完成后再由 _loopThread 的析构退出线程
+    runInLoopAndWait([this]() {
+        _stopping = true;
+        if (_context != nullptr)
+        {
+            redisAsyncContext *ctx = _context;
+            _context = nullptr;
+            redisAsyncFree(ctx);
+        }
+    });
+}
+
+void AsyncRedisClient::start()
+{
+    _loop = _loopThread.startLoop();
+    _loop->runInLoop([this]() { connectInLoop(); });
+}
+
+void AsyncRedisClient::command(std::vector<std::string> args, ReplyCallback callback)
+{
+    if (_loop == nullptr)
+    {
+        if (callback)
+        {
+            callback(nullptr);
+        }
+        return;
+    }
+
+    _loop->runInLoop([this, args = std::move(args), callback = std::move(callback)]() mutable {
+        commandInLoop(args, std::move(callback));
+    });
+}
+
+TimerId AsyncRedisClient::runEvery(double interval, TimerCallback cb)
+{
+    return _loop->runEvery(interval, std::move(cb));
+}
+
+void AsyncRedisClient::cancel(TimerId timerId)
+{
+    // 在 Redis 线程中取消，保证返回时定时回调没有在执行
+    runInLoopAndWait([this, timerId]() { _loop->cancel(timerId); });
+}
+
+void AsyncRedisClient::runInLoopAndWait(const std::function<void()> &fn)
+{
+    if (_loop->isInLoopThread())
+    {
+        fn();
+        return;
+    }
+
+    std::promise<void> done;
+    _loop->runInLoop([&fn, &done]() {
+        fn();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+void AsyncRedisClient::connectInLoop()
+{
+    if (_stopping || _context != nullptr)
+    {
+        return;
+    }
+
+    redisAsyncContext *ctx = redisAsyncConnect(_ip.c_str(), _port);
+    if (ctx == nullptr || ctx->err)
+    {
+        LOG_ERROR << "async redis connect failed: " << (ctx ? ctx->errstr : "can't allocate context");
+        if (ctx != nullptr)
+        {
+            redisAsyncFree(ctx);
+        }
+        _loop->runAfter(kReconnectInterval, [this]() { connectInLoop(); });
+        return;
+    }
+
+    _context = ctx;
+    _context->data = this;
+
+    // 读写事件交给 hiredis 处理
+    _channel = std::make_shared<Channel>(_loop, _context->c.fd);
+    _channel->setReadCallback([this](Timestamp) {
+        if (_context != nullptr)
+        {
+            redisAsyncHandleRead(_context);
+        }
+    });
+    _channel->setWriteCallback([this]() {
+        if (_context != nullptr)
+        {
+            redisAsyncHandleWrite(_context);
+        }
+    });
+
+    _context->ev.data = this;
+    _context->ev.addRead = addRead;
+    _context->ev.delRead = delRead;
+    _context->ev.addWrite = addWrite;
+    _context->ev.delWrite = delWrite;
+    _context->ev.cleanup = cleanup;
+
+    // 设置连接回调时 hiredis 会开启写事件，用来检测非阻塞连接是否完成，因此必须在挂好事件适配器之后设置
+    redisAsyncSetConnectCallback(_context, onConnect);
+    redisAsyncSetDisconnectCallback(_context, onDisconnect);
+}
+
+void AsyncRedisClient::commandInLoop(const std::vector<std::string> &args, ReplyCallback callback)
+{
+    if (_context == nullptr)
+    {
+        if (callback)
+        {
+            callback(nullptr);
+        }
+        return;
+    }
+
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    argv.reserve(args.size());
+    argvlen.reserve(args.size());
+    for (const std::string &arg : args)
+    {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+
+    // 回调对象随命令交给 hiredis，在 onReply 中释放
+    ReplyCallback *privdata = callback ? new ReplyCallback(std::move(callback)) : nullptr;
+    if (redisAsyncCommandArgv(_context, onReply, privdata, static_cast<int>(argv.size()),
+                              argv.data(), argvlen.data()) != REDIS_OK)
+    {
+        if (privdata != nullptr)
+        {
+            (*privdata)(nullptr);
+            delete privdata;
+        }
+    }
+}
+
+void AsyncRedisClient::onConnect(const redisAsyncContext *ctx, int status)
+{
+    AsyncRedisClient *client = static_cast<AsyncRedisClient*>(ctx->data);
+    if (status != REDIS_OK)
+    {
+        // 连接失败后 hiredis 会自行释放上下文
+        LOG_ERROR << "async redis connect failed: " << ctx->errstr;
+        client->_context = nullptr;
+        if (!client->_stopping)
+        {
+            client->_loop->runAfter(kReconnectInterval, [client]() { client->connectInLoop(); });
+        }
+        return;
+    }
+    LOG_INFO << "async redis connected to " << client->_ip << ":" << client->_port;
+}
+
+void AsyncRedisClient::onDisconnect(const redisAsyncContext *ctx, int status)
+{
+    AsyncRedisClient *client = static_cast<AsyncRedisClient*>(ctx->data);
+    client->_context = nullptr;
+    if (client->_stopping)
+    {
+        return;
+    }
+    LOG_ERROR << "async redis disconnected: " << (status == REDIS_OK ? "closed" : ctx->errstr)
+              << ", reconnecting";
+    client->_loop->runAfter(kReconnectInterval, [client]() { client->connectInLoop(); });
+}
+
+void AsyncRedisClient::onReply(redisAsyncContext *, void *reply, void *privdata)
+{
+    ReplyCallback *callback = static_cast<ReplyCallback*>(privdata);
+    if (callback != nullptr)
+    {
+        (*callback)(static_cast<redisReply*>(reply));
+        delete callback;
+    }
+}
+
+void AsyncRedisClient::addRead(void *privdata)
+{
+    static_cast<AsyncRedisClient*>(privdata)->_channel->enableReading();
+}
+
+void AsyncRedisClient::delRead(void *privdata)
+{
+    static_cast<AsyncRedisClient*>(privdata)->_channel->disableReading();
+}
+
+void AsyncRedisClient::addWrite(void *privdata)
+{
+    static_cast<AsyncRedisClient*>(privdata)->_channel->enableWriting();
+}
+
+void AsyncRedisClient::delWrite(void *privdata)
+{
+    static_cast<AsyncRedisClient*>(privdata)->_channel->disableWriting();
+}
+
+void AsyncRedisClient::cleanup(void *privdata)
+{
+    AsyncRedisClient *client = static_cast<AsyncRedisClient*>(privdata);
+    std::shared_ptr<Channel> channel = std::move(client->_channel);
+    if (channel)
+    {
+        channel->disableAll();
+        channel->remove();
+        // 可能正处于该 Channel 的事件回调中，延后到本轮事件处理结束后再析构
+        client->_loop->queueInLoop([channel]() {});
+    }
+}
@@ -1,13 +1,57 @@
 #include "redisPub.hpp"
 #include <iostream>
+#include <cstring>
+#include <chrono>
+#include <sys/socket.h>
 #include <muduo/base/Logging.h>
 
-RedisPub::RedisPub() : publish_context_(nullptr), subcribe_context_(nullptr)
+// 批量帧格式：2字节魔数 + 若干条 [4字节大端长度][8字节大端投递顺序键][消息内容]
+// 消息是JSON文本，不会以 '\0' 开头，订阅端据此区分批量帧和单条消息
+// 帧布局变化时必须更换魔数：旧版本把新格式当作单条消息，解析JSON失败时会记录错误，不会错位解包
+static const char kBatchMagic[2] = {'\0', 'K'};
+static const size_t kBatchMagicLen = sizeof(kBatchMagic);
+static const size_t kLengthFieldLen = 4;
+static const size_t kRouteKeyLen = 8;
+
+// Streams 传输的参数
+static const std::string kStreamPrefix = "chat_stream:";
+static const char *kStreamField = "d";          // 每条流消息只有一个字段，值为一帧数据
+static const char *kStreamMaxLen = "100000";    // XADD 近似裁剪，限制流的长度
+static const char *kStreamReadCount = "256";    // 每次 XREADGROUP 最多读取的条数
+static const char *kStreamBlockMs = "1000";     // 阻塞读取的超时，超时后检查是否需要退出
+// 使用 Streams 接收的服务器登记在这个集合中，发送端据此为每个目标选择 XADD 或 PUBLISH
+static const char *kStreamServersKey = "stream_servers";
+static const double kStreamServersRefreshInterval = 1.0; // 发送端刷新集合的间隔（秒）
+// 目标的 Redis 在途帧全部得到应答后，再等这么久才切换到直连：应答只说明 Redis 已转发，
+// 对端的订阅线程可能还没读到，过早切换时直连的帧会先于它们投递
+static const std::chrono::milliseconds kDirectSwitchDelay(100);
+
+RedisPub::RedisPub()
+    : publish_context_(nullptr), async_publisher_(nullptr), subcribe_context_(nullptr),
+      delivery_executor_(nullptr), direct_routes_(std::make_shared<DirectRoutes>()), batching_(false), max_batch_bytes_(0), flush_queued_(false),
+      transport_(PUBSUB), stream_stop_(false), stream_inflight_(std::make_shared<StreamInflight>()),
+      stream_servers_(std::make_shared<StreamServers>())
 {
 }
 
 RedisPub::~RedisPub()
 {
+    stop();
+
+    if (async_publisher_ != nullptr)
+    {
+        async_publisher_->cancel(stream_servers_timer_);
+    }
+
+    // 停止定时刷新并把剩余的消息交给 Redis 线程
+    if (batching_)
+    {
+        async_publisher_->runInLoopAndWait([this]() {
+            async_publisher_->getLoop()->cancel(flush_timer_);
+            flushBatches();
+        });
+    }
+
     if (publish_context_ != nullptr)
     {
         redisFree(publish_context_);
@@ -19,6 +63,23 @@ RedisPub::~RedisPub()
     }
 }
 
+void RedisPub::stop()
+{
+    if (stream_thread_.joinable())
+    {
+        stream_stop_ = true;
+        stream_thread_.join();
+    }
+
+    if (subscribe_thread_.joinable())
+    {
+        // 关闭套接字的读写，阻塞在 redisGetReply 中的订阅线程随即返回错误并退出
+        // 订阅上下文由析构函数释放，此时一定仍然有效
+        ::shutdown(subcribe_context_->fd, SHUT_RDWR);
+        subscribe_thread_.join();
+    }
+}
+
 //连接Redis服务器
 // redisPub.cpp
 bool RedisPub::connect()
@@ -52,10 +113,244 @@ bool RedisPub::connect()
 //向Redis指定的通道channel发布消息
 // redisPub.cpp
 
-bool RedisPub::publish(string channel, string message)
+void RedisPub::setAsyncPublisher(AsyncRedisClient *client)
+{
+    async_publisher_ = client;
+    // 定时读取哪些服务器以 Streams 接收；第一次读到之前一律 PUBLISH，所有服务器都订阅了自己的通道
+    refreshStreamServers();
+    stream_servers_timer_ = async_publisher_->runEvery(kStreamServersRefreshInterval, [this]() {
+        refreshStreamServers();
+    });
+}
+
+void RedisPub::refreshStreamServers()
+{
+    std::shared_ptr<StreamServers> state = stream_servers_;
+    async_publisher_->command({"SMEMBERS", kStreamServersKey}, [state](redisReply *reply) {
+        if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY)
+        {
+            return; // 查询失败时沿用上一次的结果
+        }
+        std::unordered_set<std::string> servers;
+        for (size_t i = 0; i < reply->elements; ++i)
+        {
+            servers.emplace(reply->element[i]->str, reply->element[i]->len);
+        }
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->servers.swap(servers);
+    });
+}
+
+bool RedisPub::isStreamServer(const string &channel)
+{
+    std::lock_guard<std::mutex> lock(stream_servers_->mutex);
+    return stream_servers_->servers.count(channel) != 0;
+}
+
+void RedisPub::advertiseTransport(const string &inbox)
+{
+    if (async_publisher_ == nullptr)
+    {
+        return;
+    }
+    // Streams 服务器正常退出时不注销：重启期间发给它的消息留在流中，启动后重放
+    // 以 pub/sub 启动时注销，此前以 Streams 运行留下的登记不再生效
+    if (transport_ == STREAMS)
+    {
+        async_publisher_->command({"SADD", kStreamServersKey, inbox});
+    }
+    else
+    {
+        async_publisher_->command({"SREM", kStreamServersKey, inbox});
+    }
+}
+
+void RedisPub::enableBatching(double flush_interval, size_t max_batch_bytes)
+{
+    if (async_publisher_ == nullptr || batching_)
+    {
+        return;
+    }
+    max_batch_bytes_ = max_batch_bytes;
+    batching_ = true;
+    flush_timer_ = async_publisher_->runEvery(flush_interval, [this]() { flushBatches(); });
+}
+
+void RedisPub::flushBatches()
+{
+    std::unordered_map<std::string, std::string> batches;
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex_);
+        batches.swap(pending_batches_);
+        flush_queued_.store(false, std::memory_order_relaxed);
+    }
+
+    // 在 Redis 线程中发送，同一通道先取走的批次一定先发出
+    for (auto &batch : batches)
+    {
+        sendToChannel(batch.first, std::move(batch.second));
+    }
+}
+
+void RedisPub::setDirectSender(direct_ready ready, direct_sender sender, const vector<string> &broadcast_channels)
+{
+    direct_ready_ = std::move(ready);
+    direct_sender_ = std::move(sender);
+    broadcast_channels_.insert(broadcast_channels.begin(), broadcast_channels.end());
+}
+
+void RedisPub::dispatchInbound(const string &channel, const char *data, size_t len)
+{
+    dispatchMessage(channel, data, len);
+}
+
+void RedisPub::sendToChannel(const string &channel, string payload)
+{
+    bool broadcast = broadcast_channels_.count(channel) != 0;
+    // 按目标服务器的接收方式选择：只有登记为 Streams 接收的服务器才会读取它的流
+    // Streams 目标不走直连：直连与 pub/sub 一样不保证送达，会绕过流的持久化和重放
+    if (!broadcast && isStreamServer(channel))
+    {
+        async_publisher_->command({"XADD", kStreamPrefix + channel, "MAXLEN", "~", kStreamMaxLen,
+                                   "*", kStreamField, std::move(payload)},
+                                  [channel](redisReply *reply) {
+            if (reply == nullptr || reply->type == REDIS_REPLY_ERROR)
+            {
+                LOG_ERROR << "XADD to stream " << channel << " failed: " << (reply ? reply->str : "disconnected");
+            }
+        });
+        return;
+    }
+    bool direct = !broadcast && direct_sender_;
+    if (direct && sendDirect(channel, payload))
+    {
+        return;
+    }
+    publishToChannel(channel, std::move(payload), direct);
+}
+
+bool RedisPub::sendDirect(const string &channel, const string &payload)
+{
+    std::shared_ptr<DirectRoutes> routes = direct_routes_;
+    {
+        std::lock_guard<std::mutex> lock(routes->mutex);
+        DirectRoute &route = routes->routes[channel];
+        if (!route.direct)
+        {
+            // 从 Redis 切换到直连：该目标在 Redis 上的帧全部得到应答、且静默一小段时间之后才切换，
+            // 否则直连的帧可能先于 Redis 上的帧到达
+            if (route.redisInflight != 0 ||
+                std::chrono::steady_clock::now() - route.redisIdleSince < kDirectSwitchDelay ||
+                !direct_ready_(channel))
+            {
+                return false;
+            }
+            route.direct = true;
+        }
+        ++route.directInflight;
+    }
+
+    // 直连路径上的帧在链路线程中按提交顺序处理；链路断开时逐帧按原顺序改走 Redis，
+    // 已交给链路的帧全部处理完之后，新的帧才直接走 Redis
+    direct_sender_(channel, payload, [this, routes, channel, payload](bool sent) {
+        if (!sent)
+        {
+            publishToChannel(channel, payload, true);
+        }
+        std::lock_guard<std::mutex> lock(routes->mutex);
+        DirectRoute &route = routes->routes[channel];
+        if (--route.directInflight == 0 && !sent)
+        {
+            route.direct = false;
+        }
+    });
+    return true;
+}
+
+void RedisPub::publishToChannel(const string &channel, string payload, bool track)
+{
+    if (!track)
+    {
+        // 不关心 PUBLISH 的返回值，命令交给 Redis 线程发送即可
+        async_publisher_->command({"PUBLISH", channel, std::move(payload)});
+        return;
+    }
+
+    // 可能切换到直连的目标：记录在途帧，应答（或连接断开）后才算发送完
+    std::shared_ptr<DirectRoutes> routes = direct_routes_;
+    {
+        std::lock_guard<std::mutex> lock(routes->mutex);
+        ++routes->routes[channel].redisInflight;
+    }
+    async_publisher_->command({"PUBLISH", channel, std::move(payload)}, [routes, channel](redisReply *) {
+        std::lock_guard<std::mutex> lock(routes->mutex);
+        DirectRoute &route = routes->routes[channel];
+        --route.redisInflight;
+        route.redisIdleSince = std::chrono::steady_clock::now();
+    });
+}
+
+bool RedisPub::enableStreams(const string &inbox, const vector<string> &broadcast_channels)
+{
+    if (async_publisher_ == nullptr || transport_ == STREAMS)
+    {
+        return false;
+    }
+
+    stream_inbox_ = inbox;
+    stream_key_ = kStreamPrefix + inbox;
+    broadcast_channels_.insert(broadcast_channels.begin(), broadcast_channels.end());
+    transport_ = STREAMS;
+
+    // 读取线程使用独立的同步连接，阻塞读取不影响发布和订阅
+    stream_thread_ = thread([this]() {
+        consume_stream_messages();
+    });
+    return true;
+}
+
+bool RedisPub::publish(const string &channel, const string &message, uint64_t route_key)
 {
+    if (batching_)
+    {
+        bool full = false;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex_);
+            string &batch = pending_batches_[channel];
+            if (batch.empty())
+            {
+                batch.append(kBatchMagic, kBatchMagicLen);
+            }
+            uint32_t len = static_cast<uint32_t>(message.size());
+            char header[kLengthFieldLen + kRouteKeyLen] = {
+                static_cast<char>(len >> 24), static_cast<char>(len >> 16),
+                static_cast<char>(len >> 8), static_cast<char>(len)};
+            for (size_t i = 0; i < kRouteKeyLen; ++i)
+            {
+                header[kLengthFieldLen + i] = static_cast<char>(route_key >> (8 * (kRouteKeyLen - 1 - i)));
+            }
+            batch.append(header, sizeof(header));
+            batch.append(message);
+            full = batch.size() >= max_batch_bytes_;
+        }
+
+        // 批次已满时提前刷新：刷新只在 Redis 线程中进行，这里只负责投递一次刷新任务
+        if (full && !flush_queued_.exchange(true))
+        {
+            async_publisher_->getLoop()->queueInLoop([this]() { flushBatches(); });
+        }
+        return true;
+    }
+
+    if (async_publisher_ != nullptr)
+    {
+        sendToChannel(channel, message);
+        return true;
+    }
+
     // 使用非阻塞的 redisAppendCommand，它只将命令放入本地缓冲区
-    if (REDIS_ERR == redisAppendCommand(publish_context_, "PUBLISH %s %s", channel.c_str(), message.c_str()))
+    if (REDIS_ERR == redisAppendCommand(publish_context_, "PUBLISH %b %b", channel.data(), channel.size(),
+                                        message.data(), message.size()))
     {
         cerr << "publish command failed: redisAppendCommand" << endl;
         return false;
@@ -83,15 +378,20 @@ bool RedisPub::publish(string channel, string message)
 // redisPub.cpp
 // 完整替换 subscribe 函数
 bool RedisPub::subscribe(string channel)
+{
+    return subscribe(vector<string>{channel});
+}
+
+bool RedisPub::subscribe(const vector<string> &channels)
 {
     // 1. 将要订阅的频道名保存到成员变量中
-    subscribe_channel_ = channel;
+    subscribe_channels_ = channels;
 
     // 2. 启动监听线程。现在线程自己会去执行 SUBSCRIBE 命令
-    thread t([this]() { // 注意这里改成了 [this]
+    // 线程不再分离，stop() 中打断阻塞读取并等待其退出
+    subscribe_thread_ = thread([this]() {
         observer_channel_message();
     });
-    t.detach();
 
     return true;
 }
@@ -132,13 +432,20 @@ void RedisPub::observer_channel_message()
 
     // 3. 在这个线程内部，使用简单的 redisCommand 来执行 SUBSCRIBE
     // 这是阻塞的，但正好是我们想要的，因为它会一直等待消息
-    reply = (redisReply*)redisCommand(subcribe_context_, "SUBSCRIBE %s", subscribe_channel_.c_str());
+    // 多个通道放在同一条 SUBSCRIBE 中，其余通道的订阅确认会在下面的循环中收到并被忽略
+    vector<const char*> argv;
+    string channel_names;
+    argv.push_back("SUBSCRIBE");
+    for (const string &channel : subscribe_channels_)
+    {
+        argv.push_back(channel.c_str());
+        channel_names += channel_names.empty() ? channel : "," + channel;
+    }
+    reply = (redisReply*)redisCommandArgv(subcribe_context_, argv.size(), argv.data(), nullptr);
 
     // 检查订阅命令是否成功。如果成功，hiredis 会自动处理好一切。
     if (reply == nullptr) {
         LOG_ERROR << "SUBSCRIBE command failed.";
-        redisFree(subcribe_context_);
-        subcribe_context_ = nullptr;
         return;
     }
     // 订阅成功后，hiredis 会返回一个确认信息，我们可以释放它
@@ -146,7 +453,7 @@ void RedisPub::observer_channel_message()
 
 
     // 4. 进入接收消息的循环
-    LOG_INFO << "Observer for channel '" << subscribe_channel_ << "' started. Waiting for messages...";
+    LOG_INFO << "Observer for channel '" << channel_names << "' started. Waiting for messages...";
     
     while (redisGetReply(subcribe_context_, (void **)&reply) == REDIS_OK)
     {
@@ -158,8 +465,9 @@ void RedisPub::observer_channel_message()
             {
                 if (reply->element[1]->str != nullptr && reply->element[2]->str != nullptr)
                 {
-                    // 调用回调函数，将消息上报给业务层
-                    notify_message_handler_(reply->element[1]->str, reply->element[2]->str);
+                    // 按长度取出通道和消息，消息可能是包含 '\0' 的批量帧
+                    dispatchMessage(string(reply->element[1]->str, reply->element[1]->len),
+                                    reply->element[2]->str, reply->element[2]->len);
                 }
             }
         }
@@ -169,12 +477,215 @@ void RedisPub::observer_channel_message()
         }
     }
 
-    LOG_ERROR << "----------------------- observer_channel_message for channel '" << subscribe_channel_ << "' quit! --------------------------";
-    if (subcribe_context_) {
-        redisFree(subcribe_context_);
-        subcribe_context_ = nullptr;
+    // 订阅上下文留给析构函数释放，stop() 可能仍在使用它的套接字
+    LOG_ERROR << "----------------------- observer_channel_message for channel '" << channel_names << "' quit! --------------------------";
+}
+void RedisPub::dispatchMessage(const string &channel, const char *data, size_t len, const stream_ack &ack)
+{
+    if (len < kBatchMagicLen || memcmp(data, kBatchMagic, kBatchMagicLen) != 0)
+    {
+        // 非批量消息没有顺序键，全部落在同一个投递线程，保持原有顺序
+        deliver(channel, string(data, len), 0, ack);
+        return;
+    }
+
+    // 批量帧：逐条解包上报
+    size_t pos = kBatchMagicLen;
+    while (pos + kLengthFieldLen + kRouteKeyLen <= len)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(data + pos);
+        size_t msgLen = (static_cast<size_t>(p[0]) << 24) | (static_cast<size_t>(p[1]) << 16) |
+                        (static_cast<size_t>(p[2]) << 8) | static_cast<size_t>(p[3]);
+        uint64_t route_key = 0;
+        for (size_t i = 0; i < kRouteKeyLen; ++i)
+        {
+            route_key = (route_key << 8) | p[kLengthFieldLen + i];
+        }
+        pos += kLengthFieldLen + kRouteKeyLen;
+        if (msgLen > len - pos)
+        {
+            LOG_ERROR << "truncated batch frame on channel " << channel;
+            return;
+        }
+        deliver(channel, string(data + pos, msgLen), route_key, ack);
+        pos += msgLen;
+    }
+}
+
+void RedisPub::setDeliveryExecutor(ShardedExecutor *executor)
+{
+    delivery_executor_ = executor;
+}
+
+void RedisPub::deliver(const string &channel, string message, uint64_t route_key, const stream_ack &ack)
+{
+    if (delivery_executor_ != nullptr)
+    {
+        // 投递队列已满时退回到订阅线程中处理，以阻塞读取的方式形成背压，不丢消息
+        // 任务持有流消息的确认凭据，回调执行完、任务释放后才可能发送 XACK
+        auto task = [this, channel, message = std::move(message), ack]() {
+            notify_message_handler_(channel, message);
+        };
+        if (delivery_executor_->enqueue(static_cast<size_t>(route_key), task))
+        {
+            return;
+        }
+        task();
+        return;
+    }
+    // 调用回调函数，将消息上报给业务层
+    notify_message_handler_(channel, std::move(message));
+}
+
+// 独立线程中从本服务器的流读取消息
+void RedisPub::consume_stream_messages()
+{
+    while (!stream_stop_)
+    {
+        redisContext *context = redisConnect("127.0.0.1", 6379);
+        if (context == nullptr || context->err)
+        {
+            LOG_ERROR << "stream consumer connect redis failed, retrying";
+            if (context) redisFree(context);
+            this_thread::sleep_for(chrono::seconds(1));
+            continue;
+        }
+
+        // 1. 创建以服务器ID命名的消费组，流不存在时一并创建；消费组已存在(BUSYGROUP)说明是重启，忽略
+        //    从 0 开始：首次启动前其他服务器已写入流中的消息也要读取，不能从 $（最新）开始跳过
+        redisReply *reply = (redisReply*)redisCommand(context, "XGROUP CREATE %s %s 0 MKSTREAM",
+                                                      stream_key_.c_str(), stream_inbox_.c_str());
+        if (reply != nullptr)
+        {
+            if (reply->type == REDIS_REPLY_ERROR && strncmp(reply->str, "BUSYGROUP", 9) != 0)
+            {
+                LOG_ERROR << "XGROUP CREATE " << stream_key_ << " failed: " << reply->str;
+            }
+            freeReplyObject(reply);
+        }
+
+        // 2. 重放上次已读取但未确认的消息（例如进程在处理中途退出），按消息ID向后翻页
+        int count;
+        string cursor = "0";
+        while ((count = read_stream_batch(context, cursor)) > 0)
+        {
+        }
+
+        // 3. 阻塞读取新消息
+        LOG_INFO << "Stream consumer for '" << stream_key_ << "' started. Waiting for messages...";
+        string latest = ">";
+        while (count >= 0 && !stream_stop_)
+        {
+            count = read_stream_batch(context, latest);
+        }
+
+        redisFree(context);
+        if (!stream_stop_)
+        {
+            LOG_ERROR << "stream consumer for '" << stream_key_ << "' lost connection, reconnecting";
+            this_thread::sleep_for(chrono::seconds(1));
+        }
     }
 }
+
+stream_ack RedisPub::makeStreamAck(const string &id)
+{
+    std::shared_ptr<StreamInflight> inflight = stream_inflight_;
+    {
+        std::lock_guard<std::mutex> lock(inflight->mutex);
+        inflight->ids.insert(id);
+    }
+    // 最后一份凭据释放时发送 XACK；收到应答（或连接断开）后才移出在途集合，
+    // 期间重连重放读到这条消息时跳过，不会重复投递
+    AsyncRedisClient *client = async_publisher_;
+    std::string key = stream_key_;
+    std::string group = stream_inbox_;
+    return stream_ack(nullptr, [client, key, group, id, inflight](void *) {
+        client->command({"XACK", key, group, id}, [inflight, id](redisReply *) {
+            std::lock_guard<std::mutex> lock(inflight->mutex);
+            inflight->ids.erase(id);
+        });
+    });
+}
+
+bool RedisPub::isStreamInflight(const string &id)
+{
+    std::lock_guard<std::mutex> lock(stream_inflight_->mutex);
+    return stream_inflight_->ids.count(id) != 0;
+}
+
+int RedisPub::read_stream_batch(redisContext *context, string &last_id)
+{
+    // XREADGROUP GROUP <组> <消费者> COUNT n [BLOCK ms] STREAMS <流> <id>
+    // 每台服务器只有一个消费者，消费者名与组名相同
+    vector<const char*> argv = {"XREADGROUP", "GROUP", stream_inbox_.c_str(), stream_inbox_.c_str(),
+                                "COUNT", kStreamReadCount};
+    bool replay = last_id != ">";
+    if (!replay)
+    {
+        argv.push_back("BLOCK");
+        argv.push_back(kStreamBlockMs);
+    }
+    argv.push_back("STREAMS");
+    argv.push_back(stream_key_.c_str());
+    argv.push_back(last_id.c_str());
+
+    redisReply *reply = (redisReply*)redisCommandArgv(context, argv.size(), argv.data(), nullptr);
+    if (reply == nullptr)
+    {
+        return -1;
+    }
+    if (reply->type == REDIS_REPLY_NIL)
+    {
+        freeReplyObject(reply); // 阻塞超时，没有新消息
+        return 0;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements == 0 ||
+        reply->element[0]->type != REDIS_REPLY_ARRAY || reply->element[0]->elements != 2)
+    {
+        if (reply->type == REDIS_REPLY_ERROR)
+        {
+            LOG_ERROR << "XREADGROUP " << stream_key_ << " failed: " << reply->str;
+        }
+        freeReplyObject(reply);
+        return -1;
+    }
+
+    // 应答结构：[[流名, [[消息ID, [字段, 值]], ...]]]
+    redisReply *entries = reply->element[0]->element[1];
+    int count = 0;
+    for (size_t i = 0; i < entries->elements; ++i)
+    {
+        redisReply *entry = entries->element[i];
+        if (entry->type != REDIS_REPLY_ARRAY || entry->elements != 2)
+        {
+            continue;
+        }
+        ++count;
+        string id(entry->element[0]->str, entry->element[0]->len);
+        if (replay)
+        {
+            last_id = id;
+            // 断线前读到、仍在投递或等待确认的消息，不再重复投递
+            if (isStreamInflight(id))
+            {
+                continue;
+            }
+        }
+        // 每条流消息一份确认凭据：解包出的投递任务全部执行完才确认，
+        // 投递前进程退出的消息留在未确认列表中，重启后重放
+        stream_ack ack = makeStreamAck(id);
+        redisReply *fields = entry->element[1];
+        // 重放时已被裁剪掉的消息字段为空，凭据随即释放并确认
+        if (fields->type == REDIS_REPLY_ARRAY && fields->elements == 2)
+        {
+            dispatchMessage(stream_inbox_, fields->element[1]->str, fields->element[1]->len, ack);
+        }
+    }
+    freeReplyObject(reply);
+    return count;
+}
+
 //初始化业务层上报通道消息的回调对象
 void RedisPub::init_notify_handler(redis_handler handler)
 {
@@ -1,5 +1,40 @@
 #include "RedisStateStorage.hpp"
 #include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <muduo/base/Logging.h>
+
+// 心跳续期批量刷新的间隔（秒），远小于在线状态的TTL
+static const double kTTLFlushInterval = 1.0;
+
+// 登录占有脚本（单用户TTL模式）
+// KEYS[1]: online_users:<id>  ARGV[1]: server_id  ARGV[2]: ttl
+// 成功返回 1，已被占有时返回当前所在的服务器ID
+static const char* kClaimTTLScript =
+    "if redis.call('SET', KEYS[1], ARGV[1], 'NX', 'EX', ARGV[2]) then return 1 end "
+    "return redis.call('GET', KEYS[1])";
+
+// 登录占有脚本（服务器租约模式）
+// KEYS[1]: online_user_server  ARGV[1]: user_id  ARGV[2]: server_id  ARGV[3]: 租约key前缀
+// 映射中的服务器租约已过期时视为空闲，直接覆盖
+// 注意：租约key由映射中读出的服务器ID拼成，无法事先放进 KEYS。
+// 单机和主从部署下没有问题；Redis Cluster 要求脚本访问的key都在 KEYS 中且位于同一槽位，
+// 因此租约模式不支持 Redis Cluster（需要时可给 online_user_server 和 server_lease:* 加相同的 hash tag）
+static const char* kClaimLeaseScript =
+    "local owner = redis.call('HGET', KEYS[1], ARGV[1]) "
+    "if owner and redis.call('EXISTS', ARGV[3] .. owner) == 1 then return owner end "
+    "redis.call('HSET', KEYS[1], ARGV[1], ARGV[2]) "
+    "return 1";
+
+// 清理服务器遗留的映射（服务器租约模式）
+// KEYS[1]: online_user_server  ARGV[1]: server_id  ARGV[2..]: user_id
+// 只删除值仍为该服务器的条目，扫描期间被其他服务器覆盖的用户不受影响
+static const char* kPurgeServerUsersScript =
+    "local n = 0 "
+    "for i = 2, #ARGV do "
+    "if redis.call('HGET', KEYS[1], ARGV[i]) == ARGV[1] then redis.call('HDEL', KEYS[1], ARGV[i]) n = n + 1 end "
+    "end "
+    "return n";
 
 // RAII 辅助类，用于自动归还连接
 // 使得业务逻辑代码更简洁，且异常安全
@@ -20,7 +55,8 @@ private:
 };
 
 
-RedisStateStorage::RedisStateStorage(size_t pool_size, const char* ip, int port) : _pool_size(pool_size) {
+RedisStateStorage::RedisStateStorage(size_t pool_size, const char* ip, int port, AsyncRedisClient* async_client)
+    : _status_chunk_size(500), _mode(PER_USER_TTL), _lease_ttl(0), _async(async_client), _pool_size(pool_size) {
     for (size_t i = 0; i < _pool_size; ++i) {
         redisContext* conn = redisConnect(ip, port);
         if (conn == nullptr || conn->err) {
@@ -34,9 +70,33 @@ RedisStateStorage::RedisStateStorage(size_t pool_size, const char* ip, int port)
         }
         _connections.push(conn);
     }
+
+    _claim_ttl_sha = loadScript(kClaimTTLScript);
+    _claim_lease_sha = loadScript(kClaimLeaseScript);
+
+    if (_async != nullptr) {
+        _ttl_flush_timer = _async->runEvery(kTTLFlushInterval, [this]() { flushPendingTTL(); });
+    }
 }
 
 RedisStateStorage::~RedisStateStorage() {
+    if (_async != nullptr) {
+        _async->cancel(_ttl_flush_timer);
+    }
+
+    // 正常退出时主动释放租约，其他服务器立即把本机用户视为离线
+    if (_mode == SERVER_LEASE) {
+        _async->cancel(_lease_renew_timer);
+        redisContext* conn = nullptr;
+        ConnectionGuard guard(&conn, this);
+        if (conn != nullptr) {
+            redisReply* reply = (redisReply*)redisCommand(conn, "DEL %s%s",
+                                                           _lease_prefix.c_str(), _lease_server_id.c_str());
+            if (reply) freeReplyObject(reply);
+            purgeServerUsers(conn, _lease_server_id);
+        }
+    }
+
     std::lock_guard<std::mutex> lock(_mutex);
     while (!_connections.empty()) {
         redisContext* conn = _connections.front();
@@ -60,6 +120,14 @@ redisContext* RedisStateStorage::getConnection() {
 
 void RedisStateStorage::releaseConnection(redisContext* conn) {
     if (conn == nullptr) return;
+    // 出错的连接可能残留未读取的应答，下一个使用者会读到错位的结果，归还前重连
+    // 重连失败也放回池中，下次归还时再重试
+    if (conn->err) {
+        LOG_ERROR << "redis connection error: " << conn->errstr << ", reconnecting";
+        if (redisReconnect(conn) != REDIS_OK) {
+            LOG_ERROR << "redis reconnect failed: " << conn->errstr;
+        }
+    }
     std::lock_guard<std::mutex> lock(_mutex);
     _connections.push(conn);
     _cv.notify_one(); // 唤醒一个等待的线程
@@ -67,11 +135,218 @@ void RedisStateStorage::releaseConnection(redisContext* conn) {
 
 // === 公共接口实现 ===
 
+bool RedisStateStorage::enableServerLease(const std::string& server_id, int lease_ttl_seconds) {
+    if (_async == nullptr) {
+        LOG_ERROR << "server lease mode requires an async redis client";
+        return false;
+    }
+
+    _lease_server_id = server_id;
+    _lease_ttl = lease_ttl_seconds;
+    const std::string lease_key = _lease_prefix + server_id;
+
+    // 先同步写入一次租约，保证返回后本服务器上登录的用户能被其他服务器看到
+    {
+        redisContext* conn = nullptr;
+        ConnectionGuard guard(&conn, this);
+        if (conn == nullptr) return false;
+
+        // 以同一服务器ID重启时，上一次运行（崩溃或未清理）留下的映射会随新租约"复活"：
+        // 这些用户会被当作在线而拒绝登录，发给他们的消息也会被路由到本服务器。
+        // 取得租约之前先删掉它们；本服务器尚未处理业务，此时不会有新的映射
+        if (!purgeServerUsers(conn, server_id)) {
+            LOG_ERROR << "purge stale presence entries of server " << server_id << " failed";
+            return false;
+        }
+
+        redisReply* reply = (redisReply*)redisCommand(conn, "SET %s alive EX %d",
+                                                       lease_key.c_str(), _lease_ttl);
+        bool success = (reply != nullptr && reply->type == REDIS_REPLY_STATUS && std::string(reply->str) == "OK");
+        if (reply) freeReplyObject(reply);
+        if (!success) {
+            LOG_ERROR << "acquire server lease failed: " << lease_key;
+            return false;
+        }
+    }
+    _mode = SERVER_LEASE;
+
+    // 每三分之一个租期续租一次，允许连续两次续租失败
+    const std::string ttl_str = std::to_string(_lease_ttl);
+    _lease_renew_timer = _async->runEvery(_lease_ttl / 3.0, [this, lease_key, ttl_str]() {
+        _async->command({"SET", lease_key, "alive", "EX", ttl_str}, [lease_key](redisReply* reply) {
+            if (reply == nullptr || reply->type != REDIS_REPLY_STATUS) {
+                LOG_ERROR << "renew server lease failed: " << lease_key;
+            }
+        });
+    });
+    LOG_INFO << "server lease mode enabled, lease key " << lease_key << " ttl " << _lease_ttl << "s";
+    return true;
+}
+
+bool RedisStateStorage::purgeServerUsers(redisContext* conn, const std::string& server_id) {
+    // HSCAN 分批遍历映射，每批用脚本按值条件删除，不会长时间阻塞 Redis
+    std::string cursor = "0";
+    size_t purged = 0;
+    do {
+        redisReply* reply = (redisReply*)redisCommand(conn, "HSCAN %s %s COUNT 1000",
+                                                       _user_server_key.c_str(), cursor.c_str());
+        if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2) {
+            if (reply) freeReplyObject(reply);
+            return false;
+        }
+        cursor.assign(reply->element[0]->str, reply->element[0]->len);
+        std::vector<std::string> args{server_id};
+        redisReply* entries = reply->element[1];
+        for (size_t i = 0; i + 1 < entries->elements; i += 2) {
+            redisReply* value = entries->element[i + 1];
+            if (value->len == server_id.size() && server_id.compare(0, std::string::npos, value->str, value->len) == 0) {
+                args.emplace_back(entries->element[i]->str, entries->element[i]->len);
+            }
+        }
+        freeReplyObject(reply);
+
+        if (args.size() > 1) {
+            redisReply* del = evalScript(conn, kPurgeServerUsersScript, std::string(), {_user_server_key}, args);
+            bool ok = (del != nullptr && del->type == REDIS_REPLY_INTEGER);
+            if (ok) purged += del->integer;
+            if (del) freeReplyObject(del);
+            if (!ok) return false;
+        }
+    } while (cursor != "0");
+
+    if (purged > 0) {
+        LOG_INFO << "purged " << purged << " stale presence entries of server " << server_id;
+    }
+    return true;
+}
+
+std::string RedisStateStorage::loadScript(const char* script) {
+    redisContext* conn = nullptr;
+    ConnectionGuard guard(&conn, this);
+    if (conn == nullptr) return std::string();
+
+    std::string sha;
+    redisReply* reply = (redisReply*)redisCommand(conn, "SCRIPT LOAD %s", script);
+    if (reply != nullptr && reply->type == REDIS_REPLY_STRING) {
+        sha.assign(reply->str, reply->len);
+    }
+    if (reply) freeReplyObject(reply);
+    return sha;
+}
+
+redisReply* RedisStateStorage::evalScript(redisContext* conn, const char* script, const std::string& sha,
+                                          const std::vector<std::string>& keys,
+                                          const std::vector<std::string>& args) {
+    std::string numkeys = std::to_string(keys.size());
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    argv.push_back("EVALSHA");
+    argv.push_back(sha.c_str());
+    argv.push_back(numkeys.c_str());
+    for (const auto& key : keys) argv.push_back(key.c_str());
+    for (const auto& arg : args) argv.push_back(arg.c_str());
+    for (const char* arg : argv) argvlen.push_back(strlen(arg));
+
+    if (!sha.empty()) {
+        redisReply* reply = (redisReply*)redisCommandArgv(conn, argv.size(), argv.data(), argvlen.data());
+        // Redis 重启或执行过 SCRIPT FLUSH 后脚本缓存会丢失，此时返回 NOSCRIPT 错误
+        bool noscript = (reply != nullptr && reply->type == REDIS_REPLY_ERROR &&
+                         strncmp(reply->str, "NOSCRIPT", 8) == 0);
+        if (!noscript) {
+            return reply;
+        }
+        freeReplyObject(reply);
+    }
+
+    argv[0] = "EVAL";
+    argv[1] = script;
+    argvlen[0] = 4;
+    argvlen[1] = strlen(script);
+    return (redisReply*)redisCommandArgv(conn, argv.size(), argv.data(), argvlen.data());
+}
+
+bool RedisStateStorage::tryClaimUser(long long user_id, const std::string& server_id, std::string& owner,
+                                     int ttl_seconds) {
+    owner.clear();
+    redisContext* conn = nullptr;
+    ConnectionGuard guard(&conn, this);
+    if (conn == nullptr) return false;
+
+    std::string user_id_str = std::to_string(user_id);
+    redisReply* reply = nullptr;
+    if (_mode == SERVER_LEASE) {
+        reply = evalScript(conn, kClaimLeaseScript, _claim_lease_sha,
+                           {_user_server_key}, {user_id_str, server_id, _lease_prefix});
+    } else {
+        reply = evalScript(conn, kClaimTTLScript, _claim_ttl_sha,
+                           {_key_prefix + user_id_str}, {server_id, std::to_string(ttl_seconds)});
+    }
+    if (reply == nullptr) {
+        return false;
+    }
+
+    bool claimed = false;
+    if (reply->type == REDIS_REPLY_INTEGER && reply->integer == 1) {
+        claimed = true;
+    } else if (reply->type == REDIS_REPLY_STRING) {
+        owner.assign(reply->str, reply->len);
+    } else if (reply->type == REDIS_REPLY_ERROR) {
+        LOG_ERROR << "claim user " << user_id << " failed: " << reply->str;
+    }
+    freeReplyObject(reply);
+    return claimed;
+}
+
+bool RedisStateStorage::registerServerAddress(const std::string& server_id, const std::string& address) {
+    redisContext* conn = nullptr;
+    ConnectionGuard guard(&conn, this);
+    if (conn == nullptr) return false;
+
+    redisReply* reply = (redisReply*)redisCommand(conn, "HSET %s %s %s", _server_addr_key.c_str(),
+                                                   server_id.c_str(), address.c_str());
+    bool success = (reply != nullptr && reply->type == REDIS_REPLY_INTEGER);
+    if (reply) freeReplyObject(reply);
+    return success;
+}
+
+bool RedisStateStorage::unregisterServerAddress(const std::string& server_id) {
+    redisContext* conn = nullptr;
+    ConnectionGuard guard(&conn, this);
+    if (conn == nullptr) return false;
+
+    redisReply* reply = (redisReply*)redisCommand(conn, "HDEL %s %s", _server_addr_key.c_str(), server_id.c_str());
+    bool success = (reply != nullptr && reply->type == REDIS_REPLY_INTEGER);
+    if (reply) freeReplyObject(reply);
+    return success;
+}
+
+bool RedisStateStorage::isServerAlive(redisContext* conn, const std::string& server_id) {
+    redisReply* reply = (redisReply*)redisCommand(conn, "EXISTS %s%s", _lease_prefix.c_str(), server_id.c_str());
+    if (reply == nullptr) {
+        return false;
+    }
+    bool alive = (reply->type == REDIS_REPLY_INTEGER && reply->integer == 1);
+    freeReplyObject(reply);
+    return alive;
+}
+
 bool RedisStateStorage::setUserOnline(const std::string& user_id, const std::string& server_id, int ttl_seconds) {
     redisContext* conn = nullptr;
     ConnectionGuard guard(&conn, this); // RAII: 自动获取和释放连接
     if (conn == nullptr) return false;
 
+    if (_mode == SERVER_LEASE) {
+        // 租约模式：只记录用户所在的服务器，存活与否由服务器租约决定
+        redisReply* reply = (redisReply*)redisCommand(conn, "HSET %s %s %s", _user_server_key.c_str(),
+                                                       user_id.c_str(), server_id.c_str());
+        if (reply == nullptr) {
+            return false;
+        }
+        bool success = (reply->type == REDIS_REPLY_INTEGER);
+        freeReplyObject(reply);
+        return success;
+    }
+
     // 使用 SET key value EX seconds 命令，原子地设置键、值和过期时间
     redisReply* reply = (redisReply*)redisCommand(conn, "SET %s%s %s EX %d",
                                                    _key_prefix.c_str(), user_id.c_str(),
@@ -90,7 +365,12 @@ bool RedisStateStorage::setUserOffline(const std::string& user_id) {
     ConnectionGuard guard(&conn, this);
     if (conn == nullptr) return false;
 
-    redisReply* reply = (redisReply*)redisCommand(conn, "DEL %s%s", _key_prefix.c_str(), user_id.c_str());
+    redisReply* reply = nullptr;
+    if (_mode == SERVER_LEASE) {
+        reply = (redisReply*)redisCommand(conn, "HDEL %s %s", _user_server_key.c_str(), user_id.c_str());
+    } else {
+        reply = (redisReply*)redisCommand(conn, "DEL %s%s", _key_prefix.c_str(), user_id.c_str());
+    }
     if (reply == nullptr) {
         return false;
     }
@@ -116,6 +396,24 @@ bool RedisStateStorage::getUserStatus(const std::string& user_id, std::string& s
         return false; // 连接池获取连接失败
     }
 
+    if (_mode == SERVER_LEASE) {
+        redisReply* reply = (redisReply*)redisCommand(conn, "HGET %s %s", _user_server_key.c_str(), user_id.c_str());
+        if (reply == nullptr) {
+            return false;
+        }
+        std::string owner;
+        if (reply->type == REDIS_REPLY_STRING) {
+            owner.assign(reply->str, reply->len);
+        }
+        freeReplyObject(reply);
+        // 映射存在且所在服务器的租约仍有效才算在线
+        if (owner.empty() || !isServerAlive(conn, owner)) {
+            return false;
+        }
+        server_id = owner;
+        return true;
+    }
+
     redisReply* reply = (redisReply*)redisCommand(conn, "GET %s%s", _key_prefix.c_str(), user_id.c_str());
     if (reply == nullptr) {
         // 命令执行失败，可能是Redis服务断开
@@ -137,6 +435,9 @@ bool RedisStateStorage::getUserStatus(const std::string& user_id, std::string& s
 
 // RedisStateStorage.cpp
 bool RedisStateStorage::refreshUserTTL(long long user_id, int ttl_seconds) {
+    // 租约模式下用户的存活由服务器租约代表，心跳不需要写Redis
+    if (_mode == SERVER_LEASE) return true;
+
     redisContext* conn = nullptr;
     ConnectionGuard guard(&conn, this);
     if (conn == nullptr) return false;
@@ -158,6 +459,66 @@ bool RedisStateStorage::refreshUserTTL(long long user_id, int ttl_seconds) {
 
 
 
+bool RedisStateStorage::pipelinedMultiGet(redisContext* conn, const std::vector<std::string>& head,
+                                          const std::vector<std::string>& names,
+                                          std::vector<std::string>& values) {
+    values.assign(names.size(), std::string());
+    const size_t chunk_size = _status_chunk_size;
+    const size_t chunk_count = (names.size() + chunk_size - 1) / chunk_size;
+
+    // 1. 每个分块一条命令，全部追加到输出缓冲区，第一次 redisGetReply 时一起写出
+    //    分块让 Redis 能在两条命令之间处理其他客户端的请求，单条命令也不会过大
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    size_t appended = 0;
+    for (size_t begin = 0; begin < names.size(); begin += chunk_size) {
+        size_t end = std::min(begin + chunk_size, names.size());
+        argv.clear();
+        argvlen.clear();
+        for (const auto& arg : head) {
+            argv.push_back(arg.data());
+            argvlen.push_back(arg.size());
+        }
+        for (size_t i = begin; i < end; ++i) {
+            argv.push_back(names[i].data());
+            argvlen.push_back(names[i].size());
+        }
+        if (redisAppendCommandArgv(conn, argv.size(), argv.data(), argvlen.data()) != REDIS_OK) {
+            // 已追加的命令仍会发出，读掉它们的应答再返回，连接才能安全归还
+            for (size_t i = 0; i < appended; ++i) {
+                redisReply* reply = nullptr;
+                if (redisGetReply(conn, (void**)&reply) != REDIS_OK) break;
+                if (reply) freeReplyObject(reply);
+            }
+            return false;
+        }
+        ++appended;
+    }
+
+    // 2. 按发送顺序逐个读取应答；返回数组与请求的名字顺序一一对应
+    //    即使某个分块出错也要读完全部应答，保证连接归还时没有残留的应答
+    bool ok = true;
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        redisReply* reply = nullptr;
+        if (redisGetReply(conn, (void**)&reply) != REDIS_OK || reply == nullptr) {
+            return false; // 连接已出错（conn->err 已置位），后续应答无法再读取，归还时重连
+        }
+        if (reply->type == REDIS_REPLY_ARRAY) {
+            size_t begin = chunk * chunk_size;
+            for (size_t i = 0; i < reply->elements && begin + i < names.size(); ++i) {
+                // 如果 reply->element[i] 的类型是 REDIS_REPLY_NIL, 说明该 key 不存在
+                if (reply->element[i]->type == REDIS_REPLY_STRING) {
+                    values[begin + i].assign(reply->element[i]->str, reply->element[i]->len);
+                }
+            }
+        } else {
+            ok = false;
+        }
+        freeReplyObject(reply);
+    }
+    return ok;
+}
+
 std::unordered_map<long long, std::string> RedisStateStorage::getUsersStatus(const std::vector<long long>& user_ids) {
     std::unordered_map<long long, std::string> online_users;
     if (user_ids.empty()) {
@@ -168,38 +529,212 @@ std::unordered_map<long long, std::string> RedisStateStorage::getUsersStatus(con
     ConnectionGuard guard(&conn, this);
     if (conn == nullptr) return online_users;
 
-    // 1. 构造 MGET 命令的参数列表
-    // hiredis 的 redisCommandArgv 需要一个 `const char*` 的数组
-    std::vector<const char*> argv;
-    std::vector<std::string> keys; // string 用于管理内存，防止 C-string 指针失效
+    if (_mode == SERVER_LEASE) {
+        return getUsersStatusByLease(conn, user_ids);
+    }
 
-    // 第一个参数是命令本身 "MGET"
-    argv.push_back("MGET");
-    
     // 准备所有的 key: "online_users:1001", "online_users:1002", ...
+    std::vector<std::string> keys;
     keys.reserve(user_ids.size());
     for (long long user_id : user_ids) {
         keys.push_back(_key_prefix + std::to_string(user_id));
-        argv.push_back(keys.back().c_str());
     }
 
-    // 2. 执行 redisCommandArgv 命令
-    redisReply* reply = (redisReply*)redisCommandArgv(conn, argv.size(), argv.data(), nullptr);
-    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY) {
-        if (reply) freeReplyObject(reply);
+    // 分块流水线执行 MGET
+    std::vector<std::string> values;
+    if (!pipelinedMultiGet(conn, {"MGET"}, keys, values)) {
         return online_users;
     }
 
-    // 3. 解析返回的数组
-    // MGET 返回的数组与请求的 key 顺序一一对应
-    for (size_t i = 0; i < reply->elements; ++i) {
-        // 如果 reply->element[i] 的类型是 REDIS_REPLY_NIL, 说明该 key 不存在 (用户离线)
-        if (reply->element[i]->type == REDIS_REPLY_STRING) {
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (!values[i].empty()) {
             // 用户在线，将其加入到结果 map 中
-            online_users[user_ids[i]] = std::string(reply->element[i]->str, reply->element[i]->len);
+            online_users[user_ids[i]] = std::move(values[i]);
         }
     }
+    return online_users;
+}
 
-    freeReplyObject(reply);
+std::unordered_map<long long, std::string> RedisStateStorage::getUsersStatusByLease(
+        redisContext* conn, const std::vector<long long>& user_ids) {
+    std::unordered_map<long long, std::string> online_users;
+
+    // 1. HMGET online_user_server id1 id2 ... 查出每个用户登记的服务器
+    std::vector<std::string> fields;
+    fields.reserve(user_ids.size());
+    for (long long user_id : user_ids) {
+        fields.push_back(std::to_string(user_id));
+    }
+    std::vector<std::string> owners;
+    if (!pipelinedMultiGet(conn, {"HMGET", _user_server_key}, fields, owners)) {
+        return online_users;
+    }
+
+    std::unordered_map<std::string, bool> server_alive; // 涉及的服务器，稍后统一检查租约
+    for (size_t i = 0; i < owners.size(); ++i) {
+        if (!owners[i].empty()) {
+            server_alive.emplace(owners[i], false);
+            online_users.emplace(user_ids[i], std::move(owners[i]));
+        }
+    }
+    if (online_users.empty()) {
+        return online_users;
+    }
+
+    // 2. 服务器数量远小于用户数量，一次 MGET 检查所有相关服务器的租约
+    std::vector<std::string> lease_keys;
+    lease_keys.reserve(server_alive.size());
+    for (const auto& entry : server_alive) {
+        lease_keys.push_back(_lease_prefix + entry.first);
+    }
+    std::vector<std::string> leases;
+    if (!pipelinedMultiGet(conn, {"MGET"}, lease_keys, leases)) {
+        online_users.clear();
+        return online_users;
+    }
+    size_t i = 0;
+    for (auto& entry : server_alive) {
+        entry.second = !leases[i].empty();
+        ++i;
+    }
+
+    // 3. 去掉租约已过期服务器上的用户
+    for (auto it = online_users.begin(); it != online_users.end(); ) {
+        if (server_alive[it->second]) {
+            ++it;
+        } else {
+            it = online_users.erase(it);
+        }
+    }
     return online_users;
-}
\ No newline at end of file
+}
+
+// === 异步接口实现 ===
+
+void RedisStateStorage::getUserStatusAsync(long long user_id, StatusCallback callback) {
+    std::string user_id_str = std::to_string(user_id);
+    if (_async == nullptr) {
+        std::string server_id;
+        bool online = getUserStatus(user_id_str, server_id);
+        callback(online ? USER_ONLINE : USER_OFFLINE, server_id);
+        return;
+    }
+
+    if (_mode == SERVER_LEASE) {
+        // 先查用户所在服务器，再在 Redis 线程中接着检查该服务器的租约
+        _async->command({"HGET", _user_server_key, user_id_str}, [this, callback](redisReply* reply) {
+            if (reply == nullptr || reply->type == REDIS_REPLY_ERROR) {
+                callback(STATUS_ERROR, std::string());
+                return;
+            }
+            if (reply->type != REDIS_REPLY_STRING) {
+                callback(USER_OFFLINE, std::string());
+                return;
+            }
+            std::string server_id(reply->str, reply->len);
+            _async->command({"EXISTS", _lease_prefix + server_id}, [callback, server_id](redisReply* lease) {
+                if (lease == nullptr || lease->type != REDIS_REPLY_INTEGER) {
+                    callback(STATUS_ERROR, std::string());
+                } else if (lease->integer == 1) {
+                    callback(USER_ONLINE, server_id);
+                } else {
+                    callback(USER_OFFLINE, std::string());
+                }
+            });
+        });
+        return;
+    }
+
+    _async->command({"GET", _key_prefix + user_id_str}, [callback](redisReply* reply) {
+        // 返回字符串表示在线，NIL 表示离线；断线(nullptr)和错误应答无法判断，交给调用方处理
+        if (reply == nullptr || reply->type == REDIS_REPLY_ERROR) {
+            callback(STATUS_ERROR, std::string());
+        } else if (reply->type == REDIS_REPLY_STRING) {
+            callback(USER_ONLINE, std::string(reply->str, reply->len));
+        } else {
+            callback(USER_OFFLINE, std::string());
+        }
+    });
+}
+
+void RedisStateStorage::getServerAddressAsync(const std::string& server_id,
+                                              std::function<void(const std::string& address)> callback) {
+    if (_async == nullptr) {
+        std::string address;
+        redisContext* conn = nullptr;
+        ConnectionGuard guard(&conn, this);
+        if (conn != nullptr) {
+            redisReply* reply = (redisReply*)redisCommand(conn, "HGET %s %s", _server_addr_key.c_str(), server_id.c_str());
+            if (reply != nullptr && reply->type == REDIS_REPLY_STRING) {
+                address.assign(reply->str, reply->len);
+            }
+            if (reply) freeReplyObject(reply);
+        }
+        callback(address);
+        return;
+    }
+
+    _async->command({"HGET", _server_addr_key, server_id}, [callback](redisReply* reply) {
+        if (reply != nullptr && reply->type == REDIS_REPLY_STRING) {
+            callback(std::string(reply->str, reply->len));
+        } else {
+            callback(std::string());
+        }
+    });
+}
+
+void RedisStateStorage::setUserOfflineAsync(long long user_id) {
+    if (_async == nullptr) {
+        setUserOffline(std::to_string(user_id));
+        return;
+    }
+    if (_mode == SERVER_LEASE) {
+        _async->command({"HDEL", _user_server_key, std::to_string(user_id)});
+        return;
+    }
+    _async->command({"DEL", _key_prefix + std::to_string(user_id)});
+}
+
+void RedisStateStorage::refreshUserTTLAsync(long long user_id, int ttl_seconds) {
+    if (_mode == SERVER_LEASE) {
+        return;
+    }
+    if (_async == nullptr) {
+        refreshUserTTL(user_id, ttl_seconds);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_ttl_mutex);
+    _pending_ttl[user_id] = ttl_seconds;
+}
+
+void RedisStateStorage::flushPendingTTL() {
+    std::unordered_map<long long, int> batch;
+    {
+        std::lock_guard<std::mutex> lock(_ttl_mutex);
+        batch.swap(_pending_ttl);
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    // 同一轮事件中追加的命令由 hiredis 合并写出，整批 EXPIRE 只占一次往返
+    // 应答全部在 Redis 线程中回调，统计量不需要加锁
+    struct BatchStat {
+        size_t remaining;
+        size_t failed;
+    };
+    auto stat = std::make_shared<BatchStat>(BatchStat{batch.size(), 0});
+    for (const auto& entry : batch) {
+        _async->command({"EXPIRE", _key_prefix + std::to_string(entry.first), std::to_string(entry.second)},
+                        [stat](redisReply* reply) {
+            // EXPIRE 返回 0 说明 key 已不存在（用户已下线或已过期）
+            if (reply == nullptr || reply->type != REDIS_REPLY_INTEGER || reply->integer != 1) {
+                ++stat->failed;
+            }
+            if (--stat->remaining == 0 && stat->failed > 0) {
+                LOG_INFO << "TTL refresh failed for " << stat->failed << " users, maybe already offline.";
+            }
+        });
+    }
+}
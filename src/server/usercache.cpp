@@ -0,0 +1,106 @@
+#include "usercache.hpp"
+
+UserCache::UserCache(size_t capacity, std::chrono::milliseconds ttl, std::chrono::milliseconds negativeTtl)
+    : _shardCapacity(capacity / kShardCount + 1), _ttl(ttl), _negativeTtl(negativeTtl),
+      _maxKnownId(0), _hits(0), _negativeHits(0), _misses(0)
+{
+}
+
+bool UserCache::get(long long userId, User &user)
+{
+    Shard &shard = _shards[shardIndex(userId)];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(userId);
+        if (it != shard.index.end())
+        {
+            if (it->second->expireAt > Clock::now())
+            {
+                // 移到链表头部，标记为最近使用
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                user = it->second->user;
+                if (user.getId() == -1)
+                {
+                    _negativeHits.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    _hits.fetch_add(1, std::memory_order_relaxed);
+                }
+                return true;
+            }
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+    }
+    _misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+uint64_t UserCache::version(long long userId)
+{
+    Shard &shard = _shards[shardIndex(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.versions[versionSlot(userId)];
+}
+
+void UserCache::put(long long userId, const User &user, uint64_t version)
+{
+    bool negative = user.getId() == -1;
+    if (negative)
+    {
+        // 用户ID自增分配：大于已知最大ID的用户可能正在其他服务器上注册，不能认定为不存在
+        if (userId > _maxKnownId.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+    else
+    {
+        long long known = _maxKnownId.load(std::memory_order_relaxed);
+        while (userId > known && !_maxKnownId.compare_exchange_weak(known, userId, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    Clock::time_point expireAt = Clock::now() + (negative ? _negativeTtl : _ttl);
+    Shard &shard = _shards[shardIndex(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // 查询期间该用户（或同一版本槽的其他用户）被失效过，查询结果可能已经过时
+    if (shard.versions[versionSlot(userId)] != version)
+    {
+        return;
+    }
+
+    auto it = shard.index.find(userId);
+    if (it != shard.index.end())
+    {
+        it->second->user = user;
+        it->second->expireAt = expireAt;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+
+    // 分片已满：淘汰最久未使用的条目
+    if (shard.index.size() >= _shardCapacity)
+    {
+        shard.index.erase(shard.lru.back().userId);
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front(Entry{userId, user, expireAt});
+    shard.index[userId] = shard.lru.begin();
+}
+
+void UserCache::invalidate(long long userId)
+{
+    Shard &shard = _shards[shardIndex(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(userId);
+    if (it != shard.index.end())
+    {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+    ++shard.versions[versionSlot(userId)];
+}
@@ -0,0 +1,51 @@
+#include "userconnregistry.hpp"
+#include <mutex>
+
+void UserConnRegistry::insert(long long userId, const TcpConnectionPtr &conn)
+{
+    Shard &shard = _shards[shardIndex(userId)];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.conns[userId] = conn;
+}
+
+void UserConnRegistry::erase(long long userId)
+{
+    Shard &shard = _shards[shardIndex(userId)];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.conns.erase(userId);
+}
+
+TcpConnectionPtr UserConnRegistry::find(long long userId) const
+{
+    const Shard &shard = _shards[shardIndex(userId)];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.conns.find(userId);
+    if (it == shard.conns.end())
+    {
+        return TcpConnectionPtr();
+    }
+    return it->second;
+}
+
+void UserConnRegistry::forEach(const std::function<void(long long, const TcpConnectionPtr &)> &fn) const
+{
+    for (const Shard &shard : _shards)
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (const auto &entry : shard.conns)
+        {
+            fn(entry.first, entry.second);
+        }
+    }
+}
+
+size_t UserConnRegistry::size() const
+{
+    size_t total = 0;
+    for (const Shard &shard : _shards)
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.conns.size();
+    }
+    return total;
+}
@@ -0,0 +1,528 @@
+#include "writebehindqueue.hpp"
+#include <muduo/base/Logging.h>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 写库失败后的重试间隔，按连续失败次数翻倍，最多翻倍 kMaxRetryShift 次
+static const std::chrono::seconds kRetryInterval(1);
+static const uint32_t kMaxRetryShift = 4;
+// 一条写入单独写库时最多被服务器拒绝的次数，用尽后移到死信日志，不再阻塞后面的写入
+// 数据库不可用不计入：停机再久也不会把队列中的写入移走
+static const uint32_t kMaxRejections = 5;
+// 日志超过这个大小（且超过未落库写入的两倍）时改写为只包含未落库的写入
+static const size_t kJournalCompactBytes = 64 * 1024 * 1024;
+
+// 日志记录格式（本机字节序）：[1字节类型][8字节a][8字节b][4字节text长度][text]
+static const size_t kRecordHeaderLen = 1 + 8 + 8 + 4;
+
+WriteBehindQueue::WriteBehindQueue(size_t maxPendingBytes, std::chrono::milliseconds flushInterval, size_t maxBatchOps)
+    : _maxPendingBytes(maxPendingBytes), _flushInterval(flushInterval), _maxBatchOps(std::max<size_t>(1, maxBatchOps)),
+      _pendingBytes(0), _nextSeq(0), _inflightMinSeq(UINT64_MAX), _flushNow(false),
+      _running(false), _stopping(false), _journalFd(-1), _journalBytes(0), _fsyncJournal(false), _deadLetterFd(-1)
+{
+}
+
+WriteBehindQueue::~WriteBehindQueue()
+{
+    stop();
+}
+
+bool WriteBehindQueue::start(const std::string &journalPath, bool fsyncJournal)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_running)
+    {
+        return true;
+    }
+
+    if (!journalPath.empty())
+    {
+        _journalFd = ::open(journalPath.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (_journalFd < 0)
+        {
+            LOG_ERROR << "open write-behind journal " << journalPath << " failed: " << strerror(errno);
+            return false;
+        }
+        _journalPath = journalPath;
+        _fsyncJournal = fsyncJournal;
+        if (!replayJournal())
+        {
+            ::close(_journalFd);
+            _journalFd = -1;
+            return false;
+        }
+        if (!_pending.empty())
+        {
+            LOG_INFO << "write-behind journal replayed " << _pending.size() << " pending writes";
+        }
+    }
+
+    _running = true;
+    _stopping = false;
+    _thread = std::thread([this]() { flushLoop(); });
+    return true;
+}
+
+void WriteBehindQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running || _stopping)
+        {
+            return;
+        }
+        _stopping = true;
+    }
+    _flushCond.notify_one();
+    _thread.join();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+    if (!_pending.empty())
+    {
+        LOG_ERROR << "write-behind queue stopped with " << _pending.size() << " unwritten writes"
+                  << (_journalFd >= 0 ? ", kept in journal" : ", dropped");
+    }
+    if (_journalFd >= 0)
+    {
+        ::close(_journalFd);
+        _journalFd = -1;
+    }
+    if (_deadLetterFd >= 0)
+    {
+        ::close(_deadLetterFd);
+        _deadLetterFd = -1;
+    }
+    _flushedCond.notify_all();
+}
+
+bool WriteBehindQueue::appendOfflineMsg(long long userId, const std::string &msg)
+{
+    auto text = std::make_shared<const std::string>(msg);
+    std::lock_guard<std::mutex> lock(_mutex);
+    return appendLocked(OFFLINE_MSG, userId, 0, text);
+}
+
+bool WriteBehindQueue::appendOfflineMsgs(const std::vector<long long> &userIds, const std::string &msg)
+{
+    if (userIds.empty())
+    {
+        return true;
+    }
+
+    auto text = std::make_shared<const std::string>(msg);
+    std::lock_guard<std::mutex> lock(_mutex);
+    // 要么全部入队，要么全部交给调用方同步写入
+    size_t bytes = userIds.size() * (sizeof(WriteOp) + msg.size());
+    if (_pendingBytes + bytes > _maxPendingBytes)
+    {
+        return false;
+    }
+    for (long long userId : userIds)
+    {
+        if (!appendLocked(OFFLINE_MSG, userId, 0, text))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteBehindQueue::appendFriend(long long userId, long long friendId)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return appendLocked(FRIEND, userId, friendId, nullptr);
+}
+
+bool WriteBehindQueue::appendGroupMember(long long userId, int groupId, const std::string &role)
+{
+    auto text = std::make_shared<const std::string>(role);
+    std::lock_guard<std::mutex> lock(_mutex);
+    return appendLocked(GROUP_MEMBER, userId, groupId, text);
+}
+
+size_t WriteBehindQueue::opBytes(const WriteOp &op)
+{
+    // 共享的消息内容按每条写入各算一份，宁可高估内存占用
+    return sizeof(WriteOp) + (op.text ? op.text->size() : 0);
+}
+
+bool WriteBehindQueue::appendLocked(OpType type, long long a, long long b, const std::shared_ptr<const std::string> &text)
+{
+    if (!_running || _stopping)
+    {
+        return false;
+    }
+
+    WriteOp op{type, a, b, text, _nextSeq, 0, false};
+    size_t bytes = opBytes(op);
+    if (_pendingBytes + bytes > _maxPendingBytes)
+    {
+        return false;
+    }
+
+    ++_nextSeq;
+    if (_journalFd >= 0)
+    {
+        writeJournalLocked(op);
+    }
+    _pending.push_back(std::move(op));
+    _pendingBytes += bytes;
+
+    // 攒够一批立即刷新，否则等待定时刷新合并更多写入
+    if (_pending.size() == _maxBatchOps)
+    {
+        _flushCond.notify_one();
+    }
+    return true;
+}
+
+void WriteBehindQueue::encodeRecord(const WriteOp &op, std::string &record)
+{
+    uint32_t len = op.text ? static_cast<uint32_t>(op.text->size()) : 0;
+    record.reserve(record.size() + kRecordHeaderLen + len);
+    record.push_back(static_cast<char>(op.type));
+    record.append(reinterpret_cast<const char*>(&op.a), sizeof(op.a));
+    record.append(reinterpret_cast<const char*>(&op.b), sizeof(op.b));
+    record.append(reinterpret_cast<const char*>(&len), sizeof(len));
+    if (op.text)
+    {
+        record.append(*op.text);
+    }
+}
+
+bool WriteBehindQueue::writeAll(int fd, const std::string &data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void WriteBehindQueue::writeJournalLocked(const WriteOp &op)
+{
+    std::string record;
+    encodeRecord(op, record);
+
+    // 只写入页缓存，进程崩溃不丢失；落盘由刷新线程在写库前统一 fdatasync
+    if (!writeAll(_journalFd, record))
+    {
+        LOG_ERROR << "write-behind journal write failed: " << strerror(errno);
+        return;
+    }
+    _journalBytes += record.size();
+}
+
+void WriteBehindQueue::compactJournalLocked()
+{
+    // 先写临时文件并落盘，再原子地替换日志：任何一步失败都保留原日志，重放时最多重复写入
+    std::string tmpPath = _journalPath + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        LOG_ERROR << "open " << tmpPath << " failed: " << strerror(errno);
+        return;
+    }
+    std::string data;
+    for (const WriteOp &op : _pending)
+    {
+        encodeRecord(op, data);
+    }
+    if (!writeAll(fd, data) || ::fdatasync(fd) != 0 || ::rename(tmpPath.c_str(), _journalPath.c_str()) != 0)
+    {
+        LOG_ERROR << "compact write-behind journal failed: " << strerror(errno);
+        ::close(fd);
+        ::unlink(tmpPath.c_str());
+        return;
+    }
+    ::close(_journalFd);
+    _journalFd = fd;
+    _journalBytes = data.size();
+}
+
+void WriteBehindQueue::deadLetter(const WriteOp &op)
+{
+    if (_journalFd < 0)
+    {
+        LOG_ERROR << "write-behind gave up after " << op.rejections << " rejections, dropped write: type="
+                  << static_cast<int>(op.type) << " a=" << op.a << " b=" << op.b
+                  << " text=" << (op.text ? *op.text : std::string());
+        return;
+    }
+
+    std::string path = _journalPath + ".dead";
+    if (_deadLetterFd < 0)
+    {
+        _deadLetterFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    }
+    std::string record;
+    encodeRecord(op, record);
+    if (_deadLetterFd < 0 || !writeAll(_deadLetterFd, record))
+    {
+        LOG_ERROR << "write dead letter " << path << " failed: " << strerror(errno) << ", dropped write: type="
+                  << static_cast<int>(op.type) << " a=" << op.a << " b=" << op.b;
+        return;
+    }
+    LOG_ERROR << "write-behind gave up after " << op.rejections << " rejections, moved write to " << path;
+}
+
+bool WriteBehindQueue::replayJournal()
+{
+    std::string data;
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = ::read(_journalFd, buf, sizeof(buf))) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR << "read write-behind journal failed: " << strerror(errno);
+            return false;
+        }
+        data.append(buf, static_cast<size_t>(n));
+    }
+    _journalBytes = data.size();
+
+    // 末尾不完整的记录是崩溃时写了一半，丢弃
+    size_t pos = 0;
+    while (pos + kRecordHeaderLen <= data.size())
+    {
+        WriteOp op;
+        op.type = static_cast<OpType>(data[pos]);
+        memcpy(&op.a, data.data() + pos + 1, sizeof(op.a));
+        memcpy(&op.b, data.data() + pos + 9, sizeof(op.b));
+        uint32_t len;
+        memcpy(&len, data.data() + pos + 17, sizeof(len));
+        if (pos + kRecordHeaderLen + len > data.size())
+        {
+            break;
+        }
+        if (op.type != OFFLINE_MSG && op.type != FRIEND && op.type != GROUP_MEMBER)
+        {
+            LOG_ERROR << "corrupted write-behind journal at offset " << pos << ", ignoring the rest";
+            break;
+        }
+        if (op.type != FRIEND)
+        {
+            op.text = std::make_shared<const std::string>(data, pos + kRecordHeaderLen, len);
+        }
+        op.seq = _nextSeq++;
+        op.rejections = 0;
+        op.isolated = false;
+        _pendingBytes += opBytes(op);
+        _pending.push_back(std::move(op));
+        pos += kRecordHeaderLen + len;
+    }
+    return true;
+}
+
+bool WriteBehindQueue::sync(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    uint64_t target = _nextSeq;
+    auto flushed = [this, target]() {
+        return !_running || ((_pending.empty() || _pending.front().seq >= target) && _inflightMinSeq >= target);
+    };
+    if (flushed())
+    {
+        return true;
+    }
+    _flushNow = true;
+    _flushCond.notify_one();
+    return _flushedCond.wait_for(lock, timeout, flushed);
+}
+
+void WriteBehindQueue::flushLoop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    uint32_t failures = 0; // 连续失败的批次数，决定退避时间
+    for (;;)
+    {
+        _flushCond.wait_for(lock, _flushInterval, [this]() {
+            return _stopping || _flushNow || _pending.size() >= _maxBatchOps;
+        });
+        if (_pending.empty())
+        {
+            _flushNow = false;
+            if (_stopping)
+            {
+                break;
+            }
+            continue;
+        }
+
+        // 随一批写入被拒绝过的写入单独写库：一条被拒绝的记录会连带同一条INSERT中的其他行失败，
+        // 逐条写入才能找出被拒绝的那条，只让它累计拒绝次数
+        size_t count = _pending.front().isolated ? 1 : std::min(_maxBatchOps, _pending.size());
+        std::vector<WriteOp> batch;
+        batch.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            batch.push_back(std::move(_pending.front()));
+            _pending.pop_front();
+        }
+        _inflightMinSeq = batch.front().seq;
+        lock.unlock();
+
+        // 先让日志落盘，再写库：掉电时日志中至少保留本批之前的所有写入
+        if (_journalFd >= 0 && _fsyncJournal)
+        {
+            ::fdatasync(_journalFd);
+        }
+        std::vector<WriteOp> failed;
+        bool ok = writeBatch(batch, failed);
+
+        lock.lock();
+        size_t doneBytes = 0;
+        for (const WriteOp &op : batch)
+        {
+            doneBytes += opBytes(op);
+        }
+        // 失败的写入按原顺序放回队首，下次优先重试；被拒绝次数用尽的移到死信日志
+        for (auto it = failed.rbegin(); it != failed.rend(); ++it)
+        {
+            if (it->rejections >= kMaxRejections)
+            {
+                deadLetter(*it);
+                continue;
+            }
+            doneBytes -= opBytes(*it);
+            _pending.push_front(std::move(*it));
+        }
+        failures = ok ? 0 : failures + 1;
+        _pendingBytes -= doneBytes;
+        _inflightMinSeq = UINT64_MAX;
+        if (_pending.empty())
+        {
+            _flushNow = false;
+            // 队列中的写入已全部落库，日志可以清空；追加写入同样持有 _mutex，不会丢失
+            if (_journalFd >= 0)
+            {
+                if (::ftruncate(_journalFd, 0) != 0)
+                {
+                    LOG_ERROR << "truncate write-behind journal failed: " << strerror(errno);
+                }
+                else
+                {
+                    _journalBytes = 0;
+                }
+            }
+        }
+        else if (_journalFd >= 0 && _journalBytes > std::max(kJournalCompactBytes, 2 * _pendingBytes))
+        {
+            // 队列一直不空时日志不会被截断，改写为只包含未落库的写入，避免无限增长
+            compactJournalLocked();
+        }
+        _flushedCond.notify_all();
+
+        if (!ok)
+        {
+            LOG_ERROR << "write-behind flush failed, " << failed.size() << " writes failed";
+            if (_stopping)
+            {
+                // 停止时不再无限重试，未落库的写入留在日志中等待下次启动重放
+                break;
+            }
+            uint32_t retryShift = std::min(failures - 1, kMaxRetryShift);
+            _flushCond.wait_for(lock, kRetryInterval * (1 << retryShift), [this]() { return _stopping; });
+        }
+    }
+}
+
+bool WriteBehindQueue::writeBatch(const std::vector<WriteOp> &batch, std::vector<WriteOp> &failed)
+{
+    // 按表分组，每张表合并成多行INSERT；同一张表内保持入队顺序
+    std::vector<size_t> offlineIdx, friendIdx, groupIdx;
+    std::vector<std::pair<long long, const std::string*>> offlineRows;
+    std::vector<std::pair<long long, long long>> friendRows;
+    std::vector<GroupMemberRow> groupRows;
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        const WriteOp &op = batch[i];
+        switch (op.type)
+        {
+        case OFFLINE_MSG:
+            offlineIdx.push_back(i);
+            offlineRows.emplace_back(op.a, op.text.get());
+            break;
+        case FRIEND:
+            friendIdx.push_back(i);
+            friendRows.emplace_back(op.a, op.b);
+            break;
+        case GROUP_MEMBER:
+            groupIdx.push_back(i);
+            groupRows.push_back(GroupMemberRow{op.a, static_cast<int>(op.b), *op.text});
+            break;
+        }
+    }
+
+    std::vector<bool> done(batch.size(), false);
+    std::vector<bool> rejected(batch.size(), false);
+    auto markDone = [&done, &rejected](const std::vector<size_t> &idx, size_t written, bool tableRejected) {
+        for (size_t i = 0; i < idx.size(); ++i)
+        {
+            if (i < written)
+            {
+                done[idx[i]] = true;
+            }
+            else
+            {
+                rejected[idx[i]] = tableRejected;
+            }
+        }
+    };
+    if (!offlineRows.empty())
+    {
+        bool tableRejected = false;
+        size_t written = _offlineMsgModel.insertRows(offlineRows, &tableRejected);
+        markDone(offlineIdx, written, tableRejected);
+    }
+    if (!friendRows.empty())
+    {
+        bool tableRejected = false;
+        size_t written = _friendModel.insertBatch(friendRows, &tableRejected);
+        markDone(friendIdx, written, tableRejected);
+    }
+    if (!groupRows.empty())
+    {
+        bool tableRejected = false;
+        size_t written = _groupModel.addGroupBatch(groupRows, &tableRejected);
+        markDone(groupIdx, written, tableRejected);
+    }
+
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        if (done[i])
+        {
+            continue;
+        }
+        failed.push_back(batch[i]);
+        if (rejected[i])
+        {
+            // 单独写库被拒绝才能确定是这一条的问题；整批被拒绝时改为逐条写库再判断
+            WriteOp &op = failed.back();
+            if (batch.size() == 1)
+            {
+                ++op.rejections;
+            }
+            op.isolated = true;
+        }
+    }
+    return failed.empty();
+}